@@ -108,7 +108,20 @@ public:
 			pattern do_neg_format()        const final { return { {symbol, space, sign, value} };}
 		};
 
-		stream.imbue(std::locale(stream.getloc(), new moneypunct{}));
+		// Creating a locale allocates the facet and copies all other
+		// facets of the base locale. Do it once per base locale, which
+		// keeps whatever the caller imbued the stream with, and only
+		// imbue the stream when it does not have this locale yet.
+		// Copies of a locale compare equal, so that is a cheap check.
+		thread_local std::locale base;
+		thread_local std::locale money_locale{base, new moneypunct{}};
+		if(stream.getloc() != money_locale) {
+			if(stream.getloc() != base) {
+				base = stream.getloc();
+				money_locale = std::locale{base, new moneypunct{}};
+			}
+			stream.imbue(money_locale);
+		}
 
 		auto result = contract.m_share.value() / contract.m_initialValue - 1.0;
 		auto profit = contract.profitToInvestor();
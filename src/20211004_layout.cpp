@@ -0,0 +1,340 @@
+﻿/*
+ * Memory layout and padding
+ *
+ * Remember the Container of 20210405_pack? It holds any number of values of
+ * any type in an std::tuple. That works fine, until you have millions of them.
+ * Every type has an alignment requirement; a double usually must be at an
+ * address that is a multiple of 8. So, when a char is followed by a double,
+ * there are 7 bytes of padding in between. The compiler is not allowed to
+ * reorder the members of a struct to fix this, and std::tuple does not do it
+ * either. But we can, at compile time.
+ *
+ * Scroll down to main() and follow the program flow. Run it (in Release) to
+ * see how much it matters.
+ */
+
+// Padding is part of the language. These includes are just for this example.
+#include "bench.h"
+
+#include <array>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// The layout of a struct is fixed: members are stored in the order of
+// declaration, every member at the first offset that satisfies its alignment.
+// The size of the struct is rounded up to its largest alignment, such that the
+// next element in an array is aligned as well. This gives the smallest
+// possible size for a set of types, as if there was no padding between
+// members at all:
+template <typename... T>
+constexpr size_t packed_size()
+{
+	size_t size = 0;
+	size_t align = 1;
+	((size += sizeof(T), align = alignof(T) > align ? alignof(T) : align), ...);
+	return size == 0 ? 1 : (size + align - 1) / align * align;
+}
+
+// When all members are sorted by alignment, largest first, every member
+// automatically ends up at an aligned offset. Sizes are always a multiple of
+// the alignment, and the alignments are all powers of two, so the member after
+// it has a smaller or equal alignment, which is therefore satisfied too. This
+// computes that order: order[j] is the index (in the declared order) of the
+// j-th member in memory. It is a stable insertion sort, as std::sort is not
+// constexpr in C++17.
+template <typename... T>
+struct layout {
+	static constexpr std::array<size_t, sizeof...(T)> order = [] {
+		std::array<size_t, sizeof...(T)> o{};
+		std::array<size_t, sizeof...(T)> const align{alignof(T)...};
+
+		for(size_t i = 0; i < o.size(); i++) {
+			size_t j = i;
+			for(; j > 0 && align[o[j - 1]] < align[i]; j--)
+				o[j] = o[j - 1];
+			o[j] = i;
+		}
+
+		return o;
+	}();
+
+	// The inverse: slot[i] is the position in memory of the i-th declared
+	// member.
+	static constexpr std::array<size_t, sizeof...(T)> slot = [] {
+		std::array<size_t, sizeof...(T)> s{};
+		for(size_t j = 0; j < s.size(); j++)
+			s[order[j]] = j;
+		return s;
+	}();
+};
+
+// Now we need storage that really puts the members in the order we want.
+// The layout of std::tuple is unspecified (libstdc++ even stores them in
+// reverse order), so let's make our own. Packed<A,B,C> holds an A, followed by
+// a Packed<B,C>. The nested Packed<B,C> is rounded up to its own alignment,
+// which never exceeds the alignment of A, so the total size is still minimal.
+template <typename... T>
+struct Packed {};
+
+template <typename T0>
+struct Packed<T0> {
+	template <typename S0>
+	constexpr explicit Packed(S0&& s0)
+		: head(std::forward<S0>(s0))
+	{}
+
+	T0 head;
+};
+
+template <typename T0, typename T1, typename... T>
+struct Packed<T0, T1, T...> {
+	template <typename S0, typename... S>
+	constexpr explicit Packed(S0&& s0, S&&... s)
+		: head(std::forward<S0>(s0))
+		, tail(std::forward<S>(s)...)
+	{}
+
+	T0 head;
+	Packed<T1, T...> tail;
+};
+
+// Recursively find the J-th member of a Packed. P may be const.
+template <size_t J, typename P>
+constexpr auto& packed_get(P& p)
+{
+	if constexpr(J == 0)
+		return p.head;
+	else
+		return packed_get<J - 1>(p.tail);
+}
+
+// The same is_container/has_container as in 20210405_pack, to keep the
+// forwarding constructor from hijacking the copy constructor.
+template <typename... T>
+class Container;
+
+template <typename C>
+struct is_container { constexpr static bool value = false; };
+
+template <typename... T>
+struct is_container<Container<T...>> { constexpr static bool value = true; };
+
+template <typename... C>
+inline constexpr bool has_container_v = (is_container<std::decay_t<C>>::value || ...);
+
+// The Container. From the outside, it looks like the one of 20210405_pack:
+// the types are in the declared order. Inside, the cargo is in the order of
+// layout<T...>::order.
+template <typename... T>
+class Container {
+	using layout_type = layout<T...>;
+
+	template <size_t... J>
+	static auto stored(std::index_sequence<J...>)
+		-> Packed<std::tuple_element_t<layout_type::order[J], std::tuple<T...>>...>;
+
+	using storage_type = decltype(stored(std::make_index_sequence<sizeof...(T)>()));
+
+public:
+	constexpr static size_t size()
+	{
+		return sizeof...(T);
+	}
+
+	template <typename... S,
+		std::enable_if_t<sizeof...(S) == sizeof...(T) && !has_container_v<S...>, bool> = true>
+	constexpr explicit Container(S&&... stuff)
+		: m_cargo{permute(std::forward_as_tuple(std::forward<S>(stuff)...),
+			std::make_index_sequence<sizeof...(T)>())}
+	{}
+
+	// Access the I-th member in the declared order. The index is mapped
+	// to the position in memory at compile time, so this is just as
+	// cheap as std::get on a tuple.
+	template <size_t I>
+	constexpr auto& get() & { return packed_get<layout_type::slot[I]>(m_cargo); }
+
+	template <size_t I>
+	constexpr auto const& get() const& { return packed_get<layout_type::slot[I]>(m_cargo); }
+
+	template <size_t I>
+	constexpr auto&& get() && { return std::move(packed_get<layout_type::slot[I]>(m_cargo)); }
+
+	// A copy of the cargo as std::tuple, in the declared order.
+	constexpr std::tuple<T...> cargo() const
+	{
+		return unpacked(std::make_index_sequence<sizeof...(T)>());
+	}
+
+	template <size_t... Indices>
+	void inspect(std::index_sequence<Indices...> indices = std::index_sequence<Indices...>()) const
+	{
+		((std::cout << get<Indices>() << " "), ...);
+		std::cout << std::endl;
+	}
+
+	void inspect() const
+	{
+		inspect(std::make_index_sequence<size()>());
+	}
+
+	template <typename... S, std::enable_if_t<!has_container_v<S...>, bool> = true>
+	constexpr auto add(S&&... more_stuff) const
+	{
+		return append(std::make_index_sequence<sizeof...(T)>(), std::forward<S>(more_stuff)...);
+	}
+
+	template <typename... C>
+	constexpr auto add(Container<C...> const& container) const
+	{
+		return std::apply([this](auto const&... c) { return add(c...); }, container.cargo());
+	}
+
+	template <typename A>
+	constexpr auto operator+(A&& thing) const
+	{
+		return add(std::forward<A>(thing));
+	}
+
+private:
+	// Pick the arguments in the order of the layout. Every argument is
+	// picked exactly once, so forwarding them is fine.
+	template <typename Args, size_t... J>
+	static constexpr storage_type permute(Args&& args, std::index_sequence<J...>)
+	{
+		return storage_type{std::get<layout_type::order[J]>(std::move(args))...};
+	}
+
+	template <size_t... I>
+	constexpr std::tuple<T...> unpacked(std::index_sequence<I...>) const
+	{
+		return std::tuple<T...>{get<I>()...};
+	}
+
+	template <size_t... I, typename... S>
+	constexpr auto append(std::index_sequence<I...>, S&&... more_stuff) const
+	{
+		return Container<T..., std::decay_t<S>...>{get<I>()..., std::forward<S>(more_stuff)...};
+	}
+
+	storage_type m_cargo;
+};
+
+template <typename S0, typename... S>
+Container(S0&& stuff0, S&&... stuff) -> Container<std::decay_t<S0>, std::decay_t<S>...>;
+
+// std::get cannot be overloaded for your own types (adding things to
+// namespace std is not allowed), but a get() found by argument-dependent
+// lookup works the same. Together with tuple_size and tuple_element, this
+// makes Container tuple-like, so structured binding works too. See also
+// 20210503_bind.
+template <size_t I, typename... T>
+constexpr auto& get(Container<T...>& c) { return c.template get<I>(); }
+
+template <size_t I, typename... T>
+constexpr auto const& get(Container<T...> const& c) { return c.template get<I>(); }
+
+template <size_t I, typename... T>
+constexpr auto&& get(Container<T...>&& c) { return std::move(c).template get<I>(); }
+
+template <typename... T>
+struct std::tuple_size<Container<T...>> : std::integral_constant<size_t, sizeof...(T)> {};
+
+template <size_t I, typename... T>
+struct std::tuple_element<I, Container<T...>> { using type = std::tuple_element_t<I, std::tuple<T...>>; };
+
+// Let's check at compile time that we actually get what we want. The sizes
+// depend on the platform, so compare to packed_size(), which is the best any
+// layout can do.
+using Cargo = Container<char, double, char, long double, bool>;
+static_assert(sizeof(Cargo) == packed_size<char, double, char, long double, bool>(), "");
+static_assert(sizeof(Cargo) <= sizeof(std::tuple<char, double, char, long double, bool>), "");
+static_assert(sizeof(Container<char, int, char, short, char>) == packed_size<char, int, char, short, char>(), "");
+static_assert(sizeof(Container<bool, void*, bool>) == packed_size<bool, void*, bool>(), "");
+static_assert(sizeof(Container<double>) == sizeof(double), "");
+static_assert(Container<>::size() == 0, "");
+static_assert(layout<char, double, short>::order[0] == 1, "");
+static_assert(layout<char, double, short>::order[1] == 2, "");
+static_assert(layout<char, double, short>::order[2] == 0, "");
+static_assert(layout<char, double, short>::slot[0] == 2, "");
+static_assert(std::is_same_v<std::tuple_element_t<1, Cargo>, double>, "");
+
+// The declared order is preserved, even when evaluated at compile time.
+static_assert(Container<char, double, short>{'a', 2.5, short{3}}.get<0>() == 'a', "");
+static_assert(Container<char, double, short>{'a', 2.5, short{3}}.get<1>() == 2.5, "");
+static_assert(Container<char, double, short>{'a', 2.5, short{3}}.get<2>() == 3, "");
+
+int main(int argc, char** argv)
+{
+	// This is the Container you know. Under the hood, the std::string is
+	// stored first, then the double, then the int.
+	Container<int, double, std::string> sometimes_red{1, 2.3, "4"};
+	std::cout << "sometimes red: ";
+	sometimes_red.inspect();
+
+	// get() uses the declared order...
+	std::cout << "get<0>: " << get<0>(sometimes_red) << std::endl;
+
+	// ...and so does structured binding.
+	auto const& [ one, two, three ] = sometimes_red;
+	std::cout << "bound: " << one << " " << two << " " << three << std::endl;
+
+	// Adding things works as before; the result gets its own layout.
+	auto rarely_black = Container{5e67L}.add("more", true, 'v');
+	std::cout << "rarely black: " << std::boolalpha;
+	rarely_black.inspect();
+
+	auto commonly_white = sometimes_red + 'x' + 3;
+	std::cout << "commonly white: ";
+	commonly_white.inspect();
+	std::cout << "commonly white + rarely black: ";
+	commonly_white.add(rarely_black).inspect();
+
+	// So, how much does this save? Let's compare this Container with the
+	// plain std::tuple.
+	using Tuple = std::tuple<char, double, char, long double, bool>;
+	std::cout << std::endl
+		<< "sizeof(std::tuple<char,double,char,long double,bool>) = " << sizeof(Tuple) << std::endl
+		<< "sizeof(Container<char,double,char,long double,bool>)  = " << sizeof(Cargo) << std::endl;
+
+	// Fewer bytes means more elements per cache line, and less memory
+	// bandwidth when scanning an array of them. Scan both arrays for the
+	// double and the long double.
+	size_t n = bench::scale(argc, argv, 100000);
+	std::vector<Tuple> tuples(n, Tuple{'a', 1.0, 'b', 2.0L, true});
+	std::vector<Cargo> cargos(n, Cargo{'a', 1.0, 'b', 2.0L, true});
+
+	std::cout << std::endl << "Scan " << n << " elements:" << std::endl;
+
+	long double sum_tuples = 0;
+	bench::measure("std::tuple", n, [&] {
+		for(auto const& t : tuples)
+			sum_tuples += static_cast<long double>(std::get<1>(t)) + std::get<3>(t);
+		bench::escape(sum_tuples);
+	});
+
+	long double sum_cargos = 0;
+	bench::measure("Container", n, [&] {
+		for(auto const& c : cargos)
+			sum_cargos += static_cast<long double>(get<1>(c)) + get<3>(c);
+		bench::escape(sum_cargos);
+	});
+
+	// Same answer, fewer bytes.
+	return sum_tuples == sum_cargos ? 0 : 1;
+}
+
+/*
+ * Further reading:
+ *
+ * https://en.cppreference.com/w/cpp/language/object#Alignment
+ * https://en.cppreference.com/w/cpp/language/structured_binding
+ * http://www.catb.org/esr/structure-packing/
+ *
+ * See also 20210405_pack, which introduces the Container.
+ */
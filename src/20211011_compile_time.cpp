@@ -0,0 +1,388 @@
+﻿/*
+ * Compile time
+ *
+ * Several tips do their work while compiling: the Template Turing Machine of
+ * 20210510_constexpr, has_container of 20210405_pack, the overload sets of
+ * 20210426_sfinae and the recursive accumulate() of 20210614_fold. Run-time
+ * cost is zero, but the compiler pays instead. And that bill grows quickly
+ * with the size of the input: a recursive template of N elements instantiates
+ * N types, every one of them with a pack of up to N elements.
+ *
+ * This program is a benchmark for the compiler. It generates instances of
+ * these workloads of increasing size, compiles them, and measures the time
+ * and peak memory usage of the compiler. Where the tips show a recursive
+ * formulation, the same workload is also generated with a fold expression or
+ * if constexpr, so you can see what the modern syntax buys you.
+ *
+ * Usage: 20211011_compile_time [max size [output dir [baseline.csv]]]
+ *
+ * The generated sources, the compiler's -ftime-report output (and
+ * -ftime-trace json for clang) and a results.csv are written to the output
+ * directory. When a baseline (a results.csv of an earlier run) is given, the
+ * program fails when an instance became significantly slower or bigger. This
+ * is POSIX-only, as it forks the compiler.
+ */
+
+// These includes are just for this example.
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifndef TIPS_CXX
+#  define TIPS_CXX "c++"
+#endif
+
+#ifndef TIPS_SRC_DIR
+#  define TIPS_SRC_DIR "."
+#endif
+
+// One generated program, to be compiled.
+struct Instance {
+	std::string workload;
+	std::string formulation;
+	size_t n;
+	// Either the source text, or (when empty) the path of an existing file.
+	std::string source;
+	std::string file;
+	std::vector<std::string> flags;
+
+	std::string name() const
+	{
+		return workload + "_" + formulation + "_" + std::to_string(n);
+	}
+};
+
+struct Result {
+	double seconds{};
+	long max_rss_kB{};
+	bool ok{};
+};
+
+
+
+// The workloads. Every generator returns the source of a complete program for
+// the given size.
+
+// Some types to fill the packs with.
+static std::string types(char const* prefix = "T")
+{
+	std::ostringstream s;
+	s << "template <int> struct " << prefix << " {};\n";
+	return s.str();
+}
+
+static std::string pack(size_t n, char const* prefix = "T")
+{
+	std::ostringstream s;
+	for(size_t i = 0; i < n; i++)
+		s << (i ? ", " : "") << prefix << "<" << i << ">";
+	return s.str();
+}
+
+// has_container of 20210405_pack: is any of the types in the pack a
+// Container?
+static std::string has_container(size_t n, bool recursive)
+{
+	std::ostringstream s;
+	s << "#include <type_traits>\n"
+	  << types()
+	  << "template <typename... T> struct Container {};\n"
+	  << "template <typename C> struct is_container { constexpr static bool value = false; };\n"
+	  << "template <typename... T> struct is_container<Container<T...>> { constexpr static bool value = true; };\n";
+
+	if(recursive) {
+		s << "template <typename... C> struct has_container { constexpr static bool value = false; };\n"
+		  << "template <typename C0, typename... C> struct has_container<C0, C...> {\n"
+		  << "\tconstexpr static bool value = is_container<std::decay_t<C0>>::value || has_container<C...>::value;\n"
+		  << "};\n";
+	} else {
+		s << "template <typename... C> struct has_container {\n"
+		  << "\tconstexpr static bool value = (is_container<std::decay_t<C>>::value || ...);\n"
+		  << "};\n";
+	}
+
+	// Put the Container last, such that all types have to be checked.
+	s << "static_assert(has_container<" << pack(n) << ", Container<>>::value, \"\");\n"
+	  << "static_assert(!has_container<" << pack(n) << ">::value, \"\");\n"
+	  << "int main() {}\n";
+	return s.str();
+}
+
+// accumulate() of 20210614_fold: sum all elements of a tuple. The tip uses an
+// std::tuple, but instantiating an std::tuple of N elements is already
+// quadratic by itself, which hides the difference we are interested in. An
+// std::array is tuple-like too, and cheap.
+static std::string accumulate(size_t n, bool recursive)
+{
+	std::ostringstream s;
+	s << "#include <array>\n#include <cstddef>\n#include <utility>\n";
+
+	if(recursive) {
+		s << "template <typename Tuple>\n"
+		  << "static auto accumulate(Tuple&&, std::index_sequence<>) { return 0; }\n"
+		  << "template <typename Tuple, size_t I0, size_t... I>\n"
+		  << "static auto accumulate(Tuple&& tuple, std::index_sequence<I0, I...>) {\n"
+		  << "\treturn std::get<I0>(tuple) + accumulate(tuple, std::index_sequence<I...>());\n"
+		  << "}\n";
+	} else {
+		s << "template <typename Tuple, size_t... I>\n"
+		  << "static auto accumulate(Tuple&& tuple, std::index_sequence<I...>) {\n"
+		  << "\treturn (0 + ... + std::get<I>(tuple));\n"
+		  << "}\n";
+	}
+
+	s << "int main() {\n\tstd::array<int, " << n << "> t{";
+	for(size_t i = 0; i < n; i++)
+		s << (i ? ", " : "") << (i % 7);
+	s << "};\n"
+	  << "\treturn accumulate(t, std::make_index_sequence<" << n << ">()) == 0;\n"
+	  << "}\n";
+	return s.str();
+}
+
+// The overload sets of 20210426_sfinae: one risk() overload per person type,
+// selected by enable_if. Every call has to consider all overloads. The
+// alternative is a single function that selects the answer with if
+// constexpr.
+static std::string sfinae(size_t n, bool overloads)
+{
+	std::ostringstream s;
+	s << "#include <type_traits>\n"
+	  << "template <int i> struct P { enum { id = i }; };\n";
+
+	if(overloads) {
+		for(size_t i = 0; i < n; i++)
+			s << "template <typename T, std::enable_if_t<T::id == " << i << ", int> = 0>\n"
+			  << "constexpr int risk(T&&) { return " << i * 3 + 1 << "; }\n";
+	} else {
+		s << "template <typename T>\nconstexpr int risk(T&&) {\n";
+		for(size_t i = 0; i < n; i++)
+			s << "\t" << (i ? "else " : "") << "if constexpr(std::decay_t<T>::id == " << i << ") return " << i * 3 + 1 << ";\n";
+		s << "\telse return 0;\n}\n";
+	}
+
+	s << "int main() {\n\tint sum = 0;\n";
+	for(size_t i = 0; i < n; i++)
+		s << "\tsum += risk(P<" << i << ">{});\n";
+	s << "\treturn sum == 0;\n}\n";
+	return s.str();
+}
+
+// The Template Turing Machine of 20210510_constexpr, which takes its input
+// from the TTM_INPUT macro. It measures the input; give it a tape full of
+// zeros, with a single one at the end.
+static Instance ttm(size_t n)
+{
+	std::string input;
+	for(size_t i = 1; i < n; i++)
+		input += "'0',";
+	input += "'1'";
+
+	// Every step of the machine is a nested instantiation.
+	size_t depth = 16 * n + 1000;
+
+	return Instance{"ttm", "template", n, {}, TIPS_SRC_DIR "/20210510_constexpr.cpp",
+		{"-DTTM_INPUT=" + input, "-ftemplate-depth=" + std::to_string(depth)}};
+}
+
+static std::vector<Instance> instances(size_t max_n)
+{
+	std::vector<Instance> res;
+
+	constexpr size_t pack_sizes[]{10, 30, 100, 300, 1000};
+	constexpr size_t tape_lengths[]{10, 20, 50, 100, 200, 500};
+
+	for(size_t n : pack_sizes) {
+		if(n > max_n)
+			break;
+
+		std::vector<std::string> depth{"-ftemplate-depth=" + std::to_string(n + 1000)};
+		res.push_back({"has_container", "recursive", n, has_container(n, true), {}, depth});
+		res.push_back({"has_container", "fold", n, has_container(n, false), {}, depth});
+		res.push_back({"accumulate", "recursive", n, accumulate(n, true), {}, depth});
+		res.push_back({"accumulate", "fold", n, accumulate(n, false), {}, depth});
+		res.push_back({"sfinae", "overloads", n, sfinae(n, true), {}, depth});
+		res.push_back({"sfinae", "if_constexpr", n, sfinae(n, false), {}, depth});
+	}
+
+	for(size_t n : tape_lengths) {
+		if(n > max_n)
+			break;
+
+		res.push_back(ttm(n));
+	}
+
+	return res;
+}
+
+
+
+// Run the compiler on one instance. The compiler is forked, such that we get
+// the resource usage of that process only via wait4().
+static Result compile(Instance const& instance, std::string const& dir)
+{
+	std::string base = dir + "/" + instance.name();
+	std::string file = instance.file;
+
+	if(file.empty()) {
+		file = base + ".cpp";
+		std::ofstream{file} << instance.source;
+	}
+
+	std::vector<std::string> args{TIPS_CXX, "-std=c++17", "-c", "-o", base + ".o", "-ftime-report"};
+#ifdef TIPS_CXX_CLANG
+	args.emplace_back("-ftime-trace");
+#endif
+	args.insert(args.end(), instance.flags.begin(), instance.flags.end());
+	args.push_back(file);
+
+	std::vector<char*> argv;
+	for(auto& a : args)
+		argv.push_back(a.data());
+	argv.push_back(nullptr);
+
+	std::string report = base + ".time-report.txt";
+	auto start = std::chrono::steady_clock::now();
+
+	pid_t pid = fork();
+	if(pid < 0)
+		return {};
+
+	if(pid == 0) {
+		// The child. -ftime-report writes to stderr.
+		int fd = open(report.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644); // NOLINT
+		if(fd >= 0) {
+			dup2(fd, STDERR_FILENO);
+			close(fd);
+		}
+
+		execvp(argv[0], argv.data());
+		_exit(127);
+	}
+
+	int status = 0;
+	rusage usage{};
+	if(wait4(pid, &status, 0, &usage) != pid)
+		return {};
+
+	Result res;
+	res.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+#ifdef __APPLE__
+	// macOS reports bytes instead of kilobytes.
+	res.max_rss_kB = usage.ru_maxrss / 1024;
+#else
+	res.max_rss_kB = usage.ru_maxrss;
+#endif
+	res.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	return res;
+}
+
+// Read a results.csv of an earlier run.
+static std::map<std::string, Result> read_baseline(char const* filename)
+{
+	std::map<std::string, Result> baseline;
+	std::ifstream f{filename};
+	std::string line;
+
+	// Skip the header.
+	std::getline(f, line);
+
+	while(std::getline(f, line)) {
+		std::istringstream s{line};
+		std::string name;
+		std::string seconds;
+		std::string rss;
+		if(std::getline(s, name, ',') && std::getline(s, seconds, ',') && std::getline(s, rss, ','))
+			baseline[name] = Result{std::stod(seconds), std::stol(rss), true};
+	}
+
+	return baseline;
+}
+
+// When is it a regression? Compile times are noisy, so only flag it when it
+// is way off.
+static bool regressed(Result const& now, Result const& before)
+{
+	return now.seconds > before.seconds * 1.5 + 0.2 ||
+		static_cast<double>(now.max_rss_kB) > static_cast<double>(before.max_rss_kB) * 1.5 + 10240.0;
+}
+
+int main(int argc, char** argv)
+{
+	size_t max_n = argc >= 2 ? std::strtoul(argv[1], nullptr, 0) : 10;
+	std::string dir = argc >= 3 ? argv[2] : "compile_time";
+	std::map<std::string, Result> baseline;
+	if(argc >= 4)
+		baseline = read_baseline(argv[3]);
+
+	if(mkdir(dir.c_str(), 0755) && errno != EEXIST) {
+		std::perror(dir.c_str());
+		return 1;
+	}
+
+	std::ofstream csv{dir + "/results.csv"};
+	csv << "instance,seconds,max_rss_kB" << std::endl;
+
+	std::cout << "Compiling with " << TIPS_CXX << "; output in " << dir << std::endl << std::endl
+		<< std::left << std::setw(36) << "instance" << std::right
+		<< std::setw(10) << "time [s]" << std::setw(14) << "memory [MiB]" << std::endl;
+
+	int ret = 0;
+
+	for(auto const& instance : instances(max_n)) {
+		auto res = compile(instance, dir);
+
+		std::cout << std::left << std::setw(36) << instance.name() << std::right
+			<< std::fixed << std::setprecision(2)
+			<< std::setw(10) << res.seconds
+			<< std::setw(14) << static_cast<double>(res.max_rss_kB) / 1024.0;
+
+		if(!res.ok) {
+			// Probably hit some compiler limit. That is a result too.
+			std::cout << "  failed";
+			ret = 1;
+		} else {
+			csv << instance.name() << "," << res.seconds << "," << res.max_rss_kB << std::endl;
+		}
+
+		if(auto b = baseline.find(instance.name()); b != baseline.end() && regressed(res, b->second)) {
+			std::cout << "  regression (was " << b->second.seconds << " s)";
+			ret = 1;
+		}
+
+		std::cout << std::endl;
+	}
+
+	// You will notice that the recursive formulations grow much faster than
+	// the folds. A recursive template over N types instantiates N class
+	// templates, and every instantiation carries a pack of up to N types;
+	// that is quadratic in the size of the pack. A fold expression is
+	// expanded in one go. The overload set and the if constexpr chain are
+	// both quadratic: every call considers every alternative. If constexpr
+	// does not help there; a lookup table indexed by id would.
+	return ret;
+}
+
+/*
+ * Further reading:
+ *
+ * https://gcc.gnu.org/onlinedocs/gcc/Developer-Options.html (-ftime-report)
+ * https://clang.llvm.org/docs/ClangCommandLineReference.html (-ftime-trace)
+ *
+ * See also 20210405_pack, 20210426_sfinae, 20210510_constexpr and
+ * 20210614_fold for the original workloads.
+ */
@@ -0,0 +1,355 @@
+﻿/*
+ * std::to_chars
+ *
+ * Streams are flexible. You can imbue them with a locale, set the precision,
+ * toggle std::showbase, and pass money through std::put_money. But all this
+ * flexibility is looked up, virtually dispatched and checked for every value
+ * you print. When you print a report of a million lines, that adds up.
+ *
+ * C++17 adds std::to_chars, which converts a number to characters in a buffer
+ * you provide. No locale, no allocation, no exceptions, no virtual calls.
+ * It is the fastest conversion the standard library offers. Let's use it to
+ * print the contracts of 20210412_brace_init.
+ *
+ * Scroll down to main() and follow the program flow. Run the program to see
+ * the difference.
+ */
+
+// This header defines std::to_chars. The others are just for this example.
+#include <charconv>
+
+#include "bench.h"
+
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <locale>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The types of 20210412_brace_init, stripped to what we need here.
+struct Bank {
+	std::string name;
+};
+
+class Investor {
+public:
+	explicit Investor(std::string name)
+		: m_name{std::move(name)}
+	{}
+
+	std::string const& name() const { return m_name; }
+
+private:
+	std::string m_name{"anonymous"};
+};
+
+struct Company {
+	std::string const name{"???"};
+	double value{};
+};
+
+struct Share {
+	Company const& company;
+	Bank const& owner;
+	double amount{};
+
+	double value() const { return company.value * amount; }
+};
+
+class Contract {
+public:
+	Contract(Bank const& bank, Investor const& investor, Company const& company, double value, double rate)
+		: m_bank{bank}
+		, m_investor{investor}
+		, m_share{company, bank, value / company.value}
+		, m_rate{rate}
+		, m_initialValue{m_share.value()}
+	{}
+
+	double totalReturn() const      { return m_share.value() - m_initialValue; }
+	double profitToInvestor() const { return totalReturn() - profitToBank(); }
+	double profitToBank() const     { return m_rate * m_initialValue; }
+	double change() const           { return m_share.value() / m_initialValue - 1.0; }
+
+	Bank const& bank() const         { return m_bank; }
+	Investor const& investor() const { return m_investor; }
+	Share const& share() const       { return m_share; }
+
+private:
+	Bank const& m_bank;
+	Investor const& m_investor;
+	Share m_share;
+	double m_rate{};
+	double m_initialValue{};
+};
+
+// The money format of the tip.
+class moneypunct : public std::moneypunct<char> {
+protected:
+	char do_thousands_sep()        const final { return '\''; }
+	std::string do_grouping()      const final { return "\3"; }
+	std::string do_curr_symbol()   const final { return "$"; }
+	int do_frac_digits()           const final { return 0; }
+	std::string do_negative_sign() const final { return "-"; }
+	pattern do_pos_format()        const final { return { {symbol, space, value} };}
+	pattern do_neg_format()        const final { return { {symbol, space, sign, value} };}
+};
+
+// This is how 20210412_brace_init printed a Contract originally: a new locale
+// for every line.
+static void print_imbue(std::ostream& stream, Contract const& contract)
+{
+	stream.imbue(std::locale(stream.getloc(), new moneypunct{}));
+
+	auto profit = contract.profitToInvestor();
+	stream.precision(0);
+	stream
+		<< std::showbase << std::fixed
+		<< "Share of " << contract.share().company.name
+		<< " changed value by " << contract.change() * 100.0 << "% to " << std::put_money(contract.share().value()) << "; "
+		<< contract.bank().name << " earns " << std::put_money(contract.profitToBank()) << ", "
+		<< contract.investor().name() << (profit >= 0 ? " earns " : " loses ") << std::put_money(std::fabs(profit))
+		<< '\n';
+}
+
+// This is how it does it now: the locale is created once per base locale of
+// the stream.
+static void print_cached(std::ostream& stream, Contract const& contract)
+{
+	thread_local std::locale base;
+	thread_local std::locale money_locale{base, new moneypunct{}};
+	if(stream.getloc() != money_locale) {
+		if(stream.getloc() != base) {
+			base = stream.getloc();
+			money_locale = std::locale{base, new moneypunct{}};
+		}
+		stream.imbue(money_locale);
+	}
+
+	auto profit = contract.profitToInvestor();
+	stream.precision(0);
+	stream
+		<< std::showbase << std::fixed
+		<< "Share of " << contract.share().company.name
+		<< " changed value by " << contract.change() * 100.0 << "% to " << std::put_money(contract.share().value()) << "; "
+		<< contract.bank().name << " earns " << std::put_money(contract.profitToBank()) << ", "
+		<< contract.investor().name() << (profit >= 0 ? " earns " : " loses ") << std::put_money(std::fabs(profit))
+		<< '\n';
+}
+
+// Now without streams. This is the same money format as the moneypunct above,
+// but as plain data.
+struct MoneyFormat {
+	std::string_view currency{"$ "};
+	char thousands_sep{'\''};
+	unsigned grouping{3};
+	char negative_sign{'-'};
+};
+
+// Write an integral number with thousand separators to out, and return the
+// end of the written characters. std::to_chars does the conversion to digits;
+// we only insert the separators.
+static char* format_grouped(char* out, long long value, MoneyFormat const& fmt)
+{
+	unsigned long long u = value < 0
+		? 0ULL - static_cast<unsigned long long>(value)
+		: static_cast<unsigned long long>(value);
+
+	if(value < 0)
+		*out++ = fmt.negative_sign;
+
+	char digits[24];
+	auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), u);
+	(void)ec; // 24 characters always fit an unsigned long long.
+
+	auto len = static_cast<unsigned>(end - digits);
+	if(fmt.grouping == 0 || len <= fmt.grouping) {
+		std::memcpy(out, digits, len);
+		return out + len;
+	}
+
+	// The first group may be shorter.
+	unsigned first = len % fmt.grouping;
+	if(first == 0)
+		first = fmt.grouping;
+
+	std::memcpy(out, digits, first);
+	out += first;
+
+	for(unsigned i = first; i < len; i += fmt.grouping) {
+		*out++ = fmt.thousands_sep;
+		std::memcpy(out, digits + i, fmt.grouping);
+		out += fmt.grouping;
+	}
+
+	return out;
+}
+
+// Round like printf("%.0f") does (to nearest, ties to even), which is what the
+// stream does for the money and the fixed precision percentage.
+static long long round_like_printf(double value)
+{
+	return static_cast<long long>(std::nearbyint(value));
+}
+
+// Format an amount of money, like std::put_money with the moneypunct above.
+static char* format_money(char* out, double value, MoneyFormat const& fmt)
+{
+	std::memcpy(out, fmt.currency.data(), fmt.currency.size());
+	out += fmt.currency.size();
+	return format_grouped(out, round_like_printf(value), fmt);
+}
+
+static char* append(char* out, std::string_view s)
+{
+	std::memcpy(out, s.data(), s.size());
+	return out + s.size();
+}
+
+// A bulk formatter. It renders all lines into one buffer, which is allocated
+// up front and only grows when the estimate was too small.
+class Report {
+public:
+	explicit Report(size_t lines, MoneyFormat fmt = {})
+		: m_fmt{fmt}
+	{
+		m_buffer.resize(lines * 128U);
+	}
+
+	void add(Contract const& contract)
+	{
+		auto const& company = contract.share().company.name;
+		auto const& bank = contract.bank().name;
+		auto const& investor = contract.investor().name();
+
+		// Every number takes at most 32 characters, plus the currency.
+		// The fixed texts take less than 64.
+		reserve(company.size() + bank.size() + investor.size() + 3U * (32U + m_fmt.currency.size()) + 64U);
+
+		char* out = m_buffer.data() + m_size;
+		auto profit = contract.profitToInvestor();
+
+		out = append(out, "Share of ");
+		out = append(out, company);
+		out = append(out, " changed value by ");
+
+		// The stream prints -0 when a small negative value is rounded to
+		// zero; keep doing that.
+		double change = std::nearbyint(contract.change() * 100.0);
+		if(change == 0 && std::signbit(change))
+			*out++ = '-';
+		out = std::to_chars(out, out + 32, static_cast<long long>(change)).ptr;
+
+		out = append(out, "% to ");
+		out = format_money(out, contract.share().value(), m_fmt);
+		out = append(out, "; ");
+		out = append(out, bank);
+		out = append(out, " earns ");
+		out = format_money(out, contract.profitToBank(), m_fmt);
+		out = append(out, ", ");
+		out = append(out, investor);
+		out = append(out, profit >= 0 ? " earns " : " loses ");
+		out = format_money(out, std::fabs(profit), m_fmt);
+		*out++ = '\n';
+
+		m_size = static_cast<size_t>(out - m_buffer.data());
+	}
+
+	std::string_view str() const { return {m_buffer.data(), m_size}; }
+	void clear() { m_size = 0; }
+
+private:
+	void reserve(size_t more)
+	{
+		if(m_size + more > m_buffer.size())
+			m_buffer.resize((m_size + more) * 2U);
+	}
+
+	MoneyFormat m_fmt;
+	std::vector<char> m_buffer;
+	size_t m_size{};
+};
+
+int main(int argc, char** argv)
+{
+	// The contracts of 20210412_brace_init.
+	Bank cs{"Credit Suisse"};
+	Bank nmr{"Nomura"};
+	Bank gs{"Goldman Sachs"};
+	Company viac{"ViacomCBS", 27'000'000'000.};
+	Investor bill{"Hwang"};
+
+	std::vector<Contract> contracts{{cs, bill, viac, 1'000'000., 0.01}};
+	viac.value *= 1.05;
+	contracts.emplace_back(nmr, bill, viac, 10'000'000., 0.02);
+	contracts.emplace_back(gs, bill, viac, 100'000'000., 0.01);
+	viac.value *= 1.04;
+	viac.value *= 0.5;
+
+	// Let's see if all three produce the same output.
+	std::ostringstream imbued;
+	std::ostringstream cached;
+	Report report{contracts.size()};
+
+	for(auto const& contract : contracts) {
+		print_imbue(imbued, contract);
+		print_cached(cached, contract);
+		report.add(contract);
+	}
+
+	std::cout << report.str();
+
+	if(imbued.str() != cached.str() || cached.str() != report.str()) {
+		std::cout << "Output differs!" << std::endl;
+		return 1;
+	}
+
+	// Now, a really long report.
+	size_t n = bench::scale(argc, argv, 10000);
+	std::vector<Contract> book;
+	book.reserve(n);
+	for(size_t i = 0; i < n; i++)
+		book.push_back(contracts[i % contracts.size()]);
+
+	std::cout << std::endl << "Print " << n << " lines:" << std::endl;
+
+	bench::measure("imbue per line", n, [&] {
+		std::ostringstream s;
+		for(auto const& contract : book)
+			print_imbue(s, contract);
+		bench::escape(s);
+	});
+
+	bench::measure("cached locale", n, [&] {
+		std::ostringstream s;
+		for(auto const& contract : book)
+			print_cached(s, contract);
+		bench::escape(s);
+	});
+
+	Report bulk{n};
+	bench::measure("bulk to_chars", n, [&] {
+		for(auto const& contract : book)
+			bulk.add(contract);
+		bench::escape(bulk);
+	});
+
+	// Creating a locale is the big one. But even with a cached locale,
+	// the stream does a lot of work per value, which std::to_chars skips.
+	// The price is flexibility: the Report only knows this one format.
+	// Choose wisely; usually, streams are fast enough.
+}
+
+/*
+ * Further reading:
+ *
+ * https://en.cppreference.com/w/cpp/utility/to_chars
+ * https://en.cppreference.com/w/cpp/locale/locale
+ * https://en.cppreference.com/w/cpp/io/manip/put_money
+ *
+ * See also 20210412_brace_init.
+ */
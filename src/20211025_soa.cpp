@@ -0,0 +1,297 @@
+﻿/*
+ * Structure of arrays
+ *
+ * In 20210412_brace_init, every Contract holds references to its Bank,
+ * Investor and Company, and a Share that holds another two. Asking for the
+ * profit of a contract follows these references, and computes it again from
+ * scratch. After the value of a company changes, the program walks all
+ * contracts, one by one, to compute the total. That is fine for 21 contracts,
+ * not for 21 million.
+ *
+ * The usual way of storing data is an array of structs (AoS): one object per
+ * contract, all fields together. The alternative is a struct of arrays (SoA):
+ * one array per field. When a loop only needs a few fields, it only loads
+ * those, and the same operation on consecutive elements of an array is what
+ * the vector (SIMD) units of your CPU are made for.
+ *
+ * Scroll down to main() and follow the program flow.
+ */
+
+// These includes are just for this example.
+#include "bench.h"
+
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// First, the original. See 20210412_brace_init for the details.
+struct Company {
+	std::string const name{"???"};
+	double value{};
+};
+
+struct Share {
+	Company const& company;
+	double amount{};
+
+	double value() const { return company.value * amount; }
+};
+
+class Contract {
+public:
+	Contract(Company const& company, double value, double rate)
+		: m_share{company, value / company.value}
+		, m_rate{rate}
+		, m_initialValue{m_share.value()}
+	{}
+
+	double totalReturn() const      { return m_share.value() - m_initialValue; }
+	double profitToInvestor() const { return totalReturn() - profitToBank(); }
+	double profitToBank() const     { return m_rate * m_initialValue; }
+
+private:
+	Share m_share;
+	double m_rate{};
+	double m_initialValue{};
+};
+
+
+
+// Now the portfolio. All contracts on the shares of one company are stored
+// together, one array per field. When the value of a company changes, only
+// the contracts of that company are affected, and only these are recomputed.
+class Portfolio {
+public:
+	using Id = size_t;
+
+	Id add_company(double value)
+	{
+		m_companies.emplace_back();
+		m_companies.back().value = value;
+		return m_companies.size() - 1U;
+	}
+
+	// Like the constructor of Contract: a contract of the given value in
+	// shares of the company. Returns the index of the contract within the
+	// company.
+	size_t add_contract(Id company, double value, double rate)
+	{
+		auto& c = segment(company);
+		double amount = value / c.value;
+		double initial = amount * c.value;
+
+		c.amount.push_back(amount);
+		c.initial.push_back(initial);
+		c.rate.push_back(rate);
+
+		double profit = c.value * amount - initial - rate * initial;
+		c.profit.push_back(profit);
+		c.total += profit;
+		return c.amount.size() - 1U;
+	}
+
+	double value(Id company) const { return segment(company).value; }
+
+	// Change the value of a company. This recomputes all contracts of that
+	// company, and nothing else.
+	void set_value(Id company, double value)
+	{
+		auto& c = segment(company);
+		c.value = value;
+		c.total = recompute(value, c.amount.data(), c.initial.data(), c.rate.data(), c.profit.data(), c.amount.size());
+	}
+
+	double profitToInvestor(Id company, size_t contract) const { return segment(company).profit.at(contract); }
+	double total_profit(Id company) const { return segment(company).total; }
+
+	// The sum of the totals per company. Keeping a running total, and only
+	// adding the difference of every update, would be cheaper, but then the
+	// rounding errors of all updates add up. This is one addition per
+	// company, however many contracts there are.
+	double total_profit() const
+	{
+		double total = 0;
+		for(auto const& c : m_companies)
+			total += c.total;
+		return total;
+	}
+
+	size_t contracts(Id company) const { return segment(company).amount.size(); }
+
+private:
+	// The kernel. It takes plain pointers to the columns, and does the same
+	// thing for every element, without any branch. This is the kind of
+	// loop that compilers turn into vector instructions, with the vector
+	// width of the target: two doubles at once with SSE2, four with AVX2
+	// when enabled (like with -mavx2 or -march=native).
+	//
+	// Summing is done into four separate partial sums. Floating-point
+	// addition is not associative, so the compiler is not allowed to
+	// reorder a single running sum itself (unless you allow it with
+	// -ffast-math). With four independent sums, it does not have to.
+	static double recompute(
+		double value, double const* amount, double const* initial, double const* rate,
+		double* profit, size_t n)
+	{
+		for(size_t i = 0; i < n; i++)
+			profit[i] = value * amount[i] - initial[i] - rate[i] * initial[i];
+
+		double sum[4]{};
+		size_t i = 0;
+		for(; i + 4U <= n; i += 4U) {
+			sum[0] += profit[i];
+			sum[1] += profit[i + 1U];
+			sum[2] += profit[i + 2U];
+			sum[3] += profit[i + 3U];
+		}
+		for(; i < n; i++)
+			sum[0] += profit[i];
+
+		return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+	}
+
+	struct Segment {
+		double value{};
+		double total{};
+		std::vector<double> amount;
+		std::vector<double> initial;
+		std::vector<double> rate;
+		std::vector<double> profit;
+	};
+
+	Segment& segment(Id company)
+	{
+		if(company >= m_companies.size())
+			throw std::out_of_range{"Unknown company"};
+		return m_companies[company];
+	}
+
+	Segment const& segment(Id company) const
+	{
+		if(company >= m_companies.size())
+			throw std::out_of_range{"Unknown company"};
+		return m_companies[company];
+	}
+
+	std::vector<Segment> m_companies;
+};
+
+int main(int argc, char** argv)
+{
+	// Year 3 of 20210412_brace_init: 7 times the same three contracts.
+	Company viac{"ViacomCBS", 27'000'000'000.};
+	Portfolio portfolio;
+	auto p_viac = portfolio.add_company(viac.value);
+
+	std::vector<Contract> contracts;
+	for(int i = 0; i < 7; i++) {
+		contracts.emplace_back(viac, 1'000'000., 0.01);
+		contracts.emplace_back(viac, 10'000'000., 0.02);
+		contracts.emplace_back(viac, 100'000'000., 0.01);
+		portfolio.add_contract(p_viac, 1'000'000., 0.01);
+		portfolio.add_contract(p_viac, 10'000'000., 0.02);
+		portfolio.add_contract(p_viac, 100'000'000., 0.01);
+	}
+
+	// Uh oh...
+	viac.value *= 0.5;
+	portfolio.set_value(p_viac, portfolio.value(p_viac) * 0.5);
+
+	double total_profit = 0;
+	for(auto const& contract : contracts)
+		total_profit += contract.profitToInvestor();
+
+	std::cout << std::fixed
+		<< "Total profit (contracts): " << total_profit << std::endl
+		<< "Total profit (portfolio): " << portfolio.total_profit() << std::endl;
+
+	// Rounding differs a bit, as the sums are computed in another order.
+	if(std::fabs(total_profit - portfolio.total_profit()) > 1e-6 * std::fabs(total_profit))
+		return 1;
+
+
+
+	// Now, something bigger: n contracts spread over a hundred companies.
+	size_t n = bench::scale(argc, argv, 50000);
+	size_t const company_count = 100;
+
+	std::vector<Company> companies;
+	companies.reserve(company_count);
+	Portfolio big;
+	for(size_t c = 0; c < company_count; c++) {
+		companies.push_back({"company " + std::to_string(c), 1e9 + static_cast<double>(c) * 1e6});
+		big.add_company(companies.back().value);
+	}
+
+	std::vector<Contract> book;
+	book.reserve(n);
+	for(size_t i = 0; i < n; i++) {
+		auto c = i % company_count;
+		double value = 1e3 * static_cast<double>(i % 1000U + 1U);
+		double rate = 0.01 * static_cast<double>(i % 3U + 1U);
+		book.emplace_back(companies[c], value, rate);
+		big.add_contract(c, value, rate);
+	}
+
+	std::cout << std::endl << n << " contracts, " << company_count << " companies:" << std::endl;
+
+	// One company changes its value. The array of structs walks
+	// everything; the portfolio only that company's contracts.
+	size_t const updates = 100;
+
+	bench::measure("AoS: update one, walk all", updates, [&] {
+		for(size_t u = 0; u < updates; u++) {
+			companies[u % company_count].value *= 1.001;
+			double sum = 0;
+			for(auto const& contract : book)
+				sum += contract.profitToInvestor();
+			bench::escape(sum);
+		}
+	});
+
+	bench::measure("SoA: update one company", updates, [&] {
+		for(size_t u = 0; u < updates; u++) {
+			auto c = u % company_count;
+			big.set_value(c, big.value(c) * 1.001);
+			bench::escape(big.total_profit());
+		}
+	});
+
+	// When everything changes, the portfolio still wins, as the kernel
+	// only loads the columns it needs, in a vectorizable loop.
+	bench::measure("SoA: update all, per contract", n, [&] {
+		for(size_t c = 0; c < company_count; c++)
+			big.set_value(c, big.value(c) * 1.001);
+		bench::escape(big.total_profit());
+	});
+
+	// After all these updates, the portfolio still agrees with walking
+	// all contracts.
+	for(auto& c : companies)
+		c.value *= 1.001;
+
+	double walked = 0;
+	for(auto const& contract : book)
+		walked += contract.profitToInvestor();
+
+	std::cout << "  total profit: " << walked << " vs " << big.total_profit() << std::endl;
+	if(std::fabs(walked - big.total_profit()) > 1e-6 * std::fabs(walked))
+		return 1;
+
+	// By the way, if you only ever need the total, there is an even
+	// better way: the total of a company is value * sum(amount) -
+	// sum(initial * (1 + rate)). Two numbers per company, and no work per
+	// contract at all. Know what you need, before you optimize.
+}
+
+/*
+ * Further reading:
+ *
+ * https://en.wikipedia.org/wiki/AoS_and_SoA
+ * https://gcc.gnu.org/projects/tree-ssa/vectorization.html
+ *
+ * See also 20210412_brace_init for the original contracts.
+ */
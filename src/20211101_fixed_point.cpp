@@ -0,0 +1,422 @@
+﻿/*
+ * Fixed-point arithmetic
+ *
+ * All amounts of money in 20210412_brace_init are doubles. A double has 53
+ * bits of precision, which sounds like plenty. But $0.10 cannot be
+ * represented exactly in binary, and every addition rounds the result. Add a
+ * few million amounts, and the cents start to drift. Banks don't like that.
+ *
+ * The solution is old: count cents in an integer. Additions are exact, and
+ * rounding only happens when you multiply by something like an interest rate,
+ * in which case you get to choose how. Let's make a money type that does
+ * exactly that, and see what it costs.
+ *
+ * Scroll down to main() and follow the program flow.
+ */
+
+// These includes are just for this example.
+#include "bench.h"
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <locale>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// How to round when the result does not fit in the resolution of the type.
+enum class rounding {
+	toward_zero,
+	down,           // toward -infinity
+	up,             // toward +infinity
+	half_away,      // nearest, ties away from zero (school rounding)
+	half_even,      // nearest, ties to even (banker's rounding)
+};
+
+// The unsigned counterpart of the representation, for formatting. We can't
+// use std::make_unsigned, as it does not know __int128 in strict C++ mode.
+template <typename Rep> struct unsigned_of;
+template <> struct unsigned_of<long long> { using type = unsigned long long; };
+#ifdef __SIZEOF_INT128__
+template <> struct unsigned_of<__int128> { using type = unsigned __int128; };
+#endif
+
+// Round q + rem / den, where q and rem have the same sign (or are zero), and
+// |rem| < den. This is what you get from integer division.
+template <typename Rep>
+constexpr Rep round_quotient(Rep q, Rep rem, Rep den, rounding r)
+{
+	if(rem == 0)
+		return q;
+
+	Rep sign = rem < 0 ? -1 : 1;
+	Rep twice = rem < 0 ? -rem * 2 : rem * 2;
+
+	switch(r) {
+	case rounding::toward_zero:
+		return q;
+	case rounding::down:
+		return rem < 0 ? q - 1 : q;
+	case rounding::up:
+		return rem > 0 ? q + 1 : q;
+	case rounding::half_away:
+		return twice >= den ? q + sign : q;
+	case rounding::half_even:
+	default:
+		return twice > den || (twice == den && q % 2 != 0) ? q + sign : q;
+	}
+}
+
+// An interest rate (or any other factor), in units of 1e-9.
+class rate {
+public:
+	static constexpr long long scale = 1'000'000'000;
+
+	constexpr explicit rate(double r)
+		: m_nano{static_cast<long long>(r * static_cast<double>(scale) + (r < 0 ? -0.5 : 0.5))}
+	{}
+
+	constexpr long long nano() const { return m_nano; }
+	constexpr double to_double() const { return static_cast<double>(m_nano) / static_cast<double>(scale); }
+
+private:
+	long long m_nano;
+};
+
+// The money type. Rep is the integer type that holds the amount in units of
+// 10^-Decimals.
+template <typename Rep, unsigned Decimals>
+class basic_money {
+	static constexpr Rep pow10(unsigned n) { return n == 0 ? 1 : 10 * pow10(n - 1); }
+
+public:
+	using rep = Rep;
+	static constexpr Rep scale = pow10(Decimals);
+
+	constexpr basic_money() = default;
+
+	// Conversion from double rounds, so make it explicit.
+	explicit basic_money(double value, rounding r = rounding::half_even)
+		: m_units{round_double(static_cast<long double>(value) * static_cast<long double>(scale), r)}
+	{}
+
+	static constexpr basic_money from_units(Rep units)
+	{
+		basic_money m;
+		m.m_units = units;
+		return m;
+	}
+
+	// Converting to a wider representation is always exact.
+	template <typename R>
+	constexpr explicit basic_money(basic_money<R, Decimals> const& m)
+		: m_units{static_cast<Rep>(m.units())}
+	{}
+
+	constexpr Rep units() const { return m_units; }
+	constexpr double to_double() const { return static_cast<double>(m_units) / static_cast<double>(scale); }
+
+	// Addition and subtraction are exact.
+	constexpr basic_money& operator+=(basic_money m) { m_units += m.m_units; return *this; }
+	constexpr basic_money& operator-=(basic_money m) { m_units -= m.m_units; return *this; }
+	friend constexpr basic_money operator+(basic_money a, basic_money b) { return a += b; }
+	friend constexpr basic_money operator-(basic_money a, basic_money b) { return a -= b; }
+	friend constexpr basic_money operator-(basic_money a) { return from_units(-a.m_units); }
+
+	friend constexpr bool operator==(basic_money a, basic_money b) { return a.m_units == b.m_units; }
+	friend constexpr bool operator!=(basic_money a, basic_money b) { return a.m_units != b.m_units; }
+	friend constexpr bool operator<(basic_money a, basic_money b) { return a.m_units < b.m_units; }
+	friend constexpr bool operator<=(basic_money a, basic_money b) { return a.m_units <= b.m_units; }
+	friend constexpr bool operator>(basic_money a, basic_money b) { return a.m_units > b.m_units; }
+	friend constexpr bool operator>=(basic_money a, basic_money b) { return a.m_units >= b.m_units; }
+
+	// Multiplication by a rate is exact up to the final rounding. The
+	// product does not fit in Rep, so split the amount: a = q * 1e9 + r.
+	// Then a * rate / 1e9 = q * rate + r * rate / 1e9, where r * rate fits.
+	constexpr basic_money multiply(rate f, rounding r) const
+	{
+		Rep den = rate::scale;
+		Rep q = m_units / den;
+		Rep rem = m_units % den;
+		Rep rem_product = rem * f.nano();
+		return from_units(round_quotient<Rep>(q * f.nano() + rem_product / den, rem_product % den, den, r));
+	}
+
+	// Multiplication by an arbitrary factor, like the amount of shares. The
+	// product is computed in long double, so it is as exact as that.
+	basic_money multiply(double f, rounding r) const
+	{
+		return from_units(round_double(static_cast<long double>(m_units) * static_cast<long double>(f), r));
+	}
+
+	// Operators use banker's rounding, which has no bias on average.
+	friend constexpr basic_money operator*(basic_money m, rate f) { return m.multiply(f, rounding::half_even); }
+	friend basic_money operator*(basic_money m, double f) { return m.multiply(f, rounding::half_even); }
+
+	// The ratio of two amounts is just a number.
+	friend constexpr double operator/(basic_money a, basic_money b)
+	{
+		return static_cast<double>(a.m_units) / static_cast<double>(b.m_units);
+	}
+
+private:
+	static Rep round_double(long double x, rounding r)
+	{
+		switch(r) {
+		case rounding::toward_zero: return static_cast<Rep>(std::trunc(x));
+		case rounding::down:        return static_cast<Rep>(std::floor(x));
+		case rounding::up:          return static_cast<Rep>(std::ceil(x));
+		case rounding::half_away:   return static_cast<Rep>(std::round(x));
+		case rounding::half_even:
+		default:                    return static_cast<Rep>(std::nearbyint(x));
+		}
+	}
+
+	Rep m_units{};
+};
+
+// Cents in 64 bits: up to $92 quadrillion. That is enough for a single
+// amount, but for totals of millions of amounts, you may want more. gcc and
+// clang have a 128-bit integer.
+using money = basic_money<long long, 2>;
+#ifdef __SIZEOF_INT128__
+using money_total = basic_money<__int128, 2>;
+#else
+using money_total = basic_money<long long, 2>;
+#endif
+
+// All groups of three digits, precomputed. Formatting a number is then just
+// copying groups, without a branch per digit or per separator.
+static constexpr auto digit_groups = [] {
+	std::array<std::array<char, 3>, 1000> g{};
+	for(unsigned i = 0; i < 1000; i++) {
+		g[i][0] = static_cast<char>('0' + i / 100);
+		g[i][1] = static_cast<char>('0' + i / 10 % 10);
+		g[i][2] = static_cast<char>('0' + i % 10);
+	}
+	return g;
+}();
+
+// Write the amount, like -1'234'567.89, to out and return the end. out must
+// have room for 64 characters.
+template <typename Rep, unsigned Decimals>
+static char* to_chars(char* out, basic_money<Rep, Decimals> m, char thousands_sep = '\'')
+{
+	using U = typename unsigned_of<Rep>::type;
+	bool negative = m.units() < 0;
+	U u = negative ? U{0} - static_cast<U>(m.units()) : static_cast<U>(m.units());
+
+	// Always write the sign, but only advance when it is negative.
+	*out = '-';
+	out += negative;
+
+	// The fraction, from right to left.
+	char frac[Decimals > 0 ? Decimals : 1];
+	for(unsigned i = Decimals; i > 0; i--) {
+		frac[i - 1] = static_cast<char>('0' + static_cast<unsigned>(u % 10U));
+		u /= 10U;
+	}
+
+	// The integral part, in groups of three, from right to left. Every
+	// group is preceded by a separator.
+	char buf[64];
+	char* end = buf + sizeof(buf);
+	char* p = end;
+	unsigned g = 0;
+	do {
+		g = static_cast<unsigned>(u % 1000U);
+		u /= 1000U;
+		p -= 3;
+		std::memcpy(p, digit_groups[g].data(), 3);
+		*--p = thousands_sep;
+	} while(u != 0);
+
+	// Drop the first separator and the leading zeros of the first group.
+	p += 1 + (g < 100) + (g < 10);
+
+	auto len = static_cast<size_t>(end - p);
+	std::memcpy(out, p, len);
+	out += len;
+
+	if(Decimals > 0) {
+		*out++ = '.';
+		std::memcpy(out, frac, Decimals);
+		out += Decimals;
+	}
+
+	return out;
+}
+
+template <typename Rep, unsigned Decimals>
+std::ostream& operator<<(std::ostream& stream, basic_money<Rep, Decimals> m)
+{
+	char buf[64];
+	return stream << "$ " << std::string{buf, to_chars(buf, m)};
+}
+
+// The contracts of 20210412_brace_init, but with the type of money as
+// template parameter. Rate is the type of the interest rate.
+template <typename Money>
+struct Company {
+	std::string const name{"???"};
+	Money value{};
+};
+
+template <typename Money>
+struct Share {
+	Company<Money> const& company;
+	double amount{};
+
+	Money value() const { return company.value * amount; }
+};
+
+template <typename Money, typename Rate = double>
+class Contract {
+public:
+	Contract(Company<Money> const& company, Money value, Rate rate)
+		: m_share{company, value / company.value}
+		, m_rate{rate}
+		, m_initialValue{m_share.value()}
+	{}
+
+	Money totalReturn() const      { return m_share.value() - m_initialValue; }
+	Money profitToInvestor() const { return totalReturn() - profitToBank(); }
+	Money profitToBank() const     { return m_initialValue * m_rate; }
+
+private:
+	Share<Money> m_share;
+	Rate m_rate;
+	Money m_initialValue{};
+};
+
+// A few compile-time checks of the rounding.
+static_assert(money::from_units(250).multiply(rate{0.01}, rounding::half_even).units() == 2, "2.5 -> 2");
+static_assert(money::from_units(350).multiply(rate{0.01}, rounding::half_even).units() == 4, "3.5 -> 4");
+static_assert(money::from_units(250).multiply(rate{0.01}, rounding::half_away).units() == 3, "2.5 -> 3");
+static_assert(money::from_units(-250).multiply(rate{0.01}, rounding::half_away).units() == -3, "-2.5 -> -3");
+static_assert(money::from_units(-250).multiply(rate{0.01}, rounding::down).units() == -3, "-2.5 -> -3");
+static_assert(money::from_units(-250).multiply(rate{0.01}, rounding::up).units() == -2, "-2.5 -> -2");
+static_assert(money::from_units(-250).multiply(rate{0.01}, rounding::toward_zero).units() == -2, "-2.5 -> -2");
+static_assert(money::from_units(1'000'000'000'000'000).multiply(rate{0.03}, rounding::half_even).units() == 30'000'000'000'000, "");
+static_assert(money::from_units(2) > money::from_units(1) && money::from_units(1) <= money::from_units(1), "");
+
+// The same format for std::put_money, for comparison.
+class moneypunct : public std::moneypunct<char> {
+protected:
+	char do_thousands_sep()        const final { return '\''; }
+	std::string do_grouping()      const final { return "\3"; }
+	int do_frac_digits()           const final { return 2; }
+};
+
+static std::string str(money m)
+{
+	std::ostringstream s;
+	s << m;
+	return s.str();
+}
+
+int main(int argc, char** argv)
+{
+	// First, formatting.
+	std::cout << money{1234567.891} << " " << money{-0.05} << " " << money{} << std::endl;
+	if(str(money{1234567.891}) != "$ 1'234'567.89" || str(money{-0.05}) != "$ -0.05" || str(money{999.0}) != "$ 999.00")
+		return 1;
+
+	// Add ten cents, a million times.
+	double d = 0;
+	money m;
+	for(int i = 0; i < 1'000'000; i++) {
+		d += 0.10;
+		m += money{0.10};
+	}
+
+	std::cout << std::fixed << std::setprecision(6)
+		<< "A million dimes as double: " << d << std::endl
+		<< "A million dimes as money:  " << m << std::endl;
+	// The double is a few cents off, the money is exact.
+	if(m != money{100'000.0})
+		return 1;
+
+	// Now, the contracts. The API is the same, only the type differs.
+	Company<double> viac_d{"ViacomCBS", 27'000'000'000.};
+	Company<money> viac_m{"ViacomCBS", money{27'000'000'000.}};
+	Contract<double> cd{viac_d, 100'000'000., 0.01};
+	Contract<money, rate> cm{viac_m, money{100'000'000.}, rate{0.01}};
+
+	viac_d.value *= 0.5;
+	viac_m.value = viac_m.value * 0.5;
+
+	std::cout << "Profit (double): " << cd.profitToInvestor() << std::endl
+		<< "Profit (money):  " << cm.profitToInvestor() << std::endl;
+
+
+
+	// Let's see what it costs.
+	size_t n = bench::scale(argc, argv, 200000);
+	std::vector<double> doubles(n);
+	std::vector<money> moneys(n);
+	for(size_t i = 0; i < n; i++) {
+		doubles[i] = static_cast<double>(i % 100000U) * 0.01;
+		moneys[i] = money::from_units(static_cast<long long>(i % 100000U));
+	}
+
+	std::cout << std::endl << "Sum " << n << " amounts:" << std::endl;
+
+	bench::measure("double", n, [&] {
+		double sum = 0;
+		for(auto x : doubles)
+			sum += x;
+		bench::escape(sum);
+	});
+
+	bench::measure("money (64-bit)", n, [&] {
+		money sum;
+		for(auto x : moneys)
+			sum += x;
+		bench::escape(sum);
+	});
+
+	bench::measure("money_total (128-bit)", n, [&] {
+		money_total sum;
+		for(auto x : moneys)
+			sum += money_total{x};
+		bench::escape(sum);
+	});
+
+	std::cout << "Print " << n << " amounts:" << std::endl;
+
+	bench::measure("double via std::put_money", n, [&] {
+		std::ostringstream s;
+		s.imbue(std::locale{std::locale{}, new moneypunct{}});
+		for(auto x : doubles)
+			s << std::put_money(static_cast<long double>(x) * 100.0L) << '\n';
+		bench::escape(s);
+	});
+
+	bench::measure("money via to_chars()", n, [&] {
+		std::vector<char> buf(n * 32U);
+		char* out = buf.data();
+		for(auto x : moneys) {
+			out = to_chars(out, x);
+			*out++ = '\n';
+		}
+		bench::escape(out);
+	});
+
+	// Integers are just as fast as doubles for additions. Only use
+	// floating point when you actually need a floating point.
+}
+
+/*
+ * Further reading:
+ *
+ * https://en.wikipedia.org/wiki/Fixed-point_arithmetic
+ * https://en.wikipedia.org/wiki/Rounding#Rounding_half_to_even
+ * https://docs.oracle.com/cd/E19957-01/806-3568/ncg_goldberg.html
+ *
+ * See also 20210412_brace_init and 20211018_to_chars.
+ */
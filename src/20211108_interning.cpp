@@ -0,0 +1,350 @@
+﻿/*
+ * Interning
+ *
+ * In 20210412_brace_init, the Year 3 array holds 21 Contracts, which are
+ * seven copies of the same three. Every Contract holds a reference to a Bank
+ * and an Investor, and a Share with a reference to a Company and the Bank
+ * again. That is 56 bytes on a 64-bit machine, of which 32 bytes are
+ * pointers, and every pointer is a potential cache miss when you follow it.
+ *
+ * Interning is storing every distinct value only once, and referring to it by
+ * a small index. Strings in compilers, symbols in Lisp, and the names in a
+ * database are all interned. Let's do the same to the contracts: banks,
+ * investors and companies go in tables, contracts refer to them by a 32-bit
+ * index, and identical contracts are stored once, with a count.
+ *
+ * Scroll down to main() and follow the program flow.
+ */
+
+// These includes are just for this example.
+#include "bench.h"
+
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// The types of 20210412_brace_init.
+struct Bank {
+	std::string name;
+};
+
+class Investor {
+public:
+	explicit Investor(std::string name)
+		: m_name{std::move(name)}
+	{}
+
+	std::string const& name() const { return m_name; }
+
+private:
+	std::string m_name{"anonymous"};
+};
+
+struct Company {
+	std::string name{"???"};
+	double value{};
+};
+
+struct Share {
+	Company const& company;
+	Bank const& owner;
+	double amount{};
+
+	double value() const { return company.value * amount; }
+};
+
+class Contract {
+public:
+	Contract(Bank const& bank, Investor const& investor, Company const& company, double value, double rate)
+		: m_bank{bank}
+		, m_investor{investor}
+		, m_share{company, bank, value / company.value}
+		, m_rate{rate}
+		, m_initialValue{m_share.value()}
+	{}
+
+	double totalReturn() const      { return m_share.value() - m_initialValue; }
+	double profitToInvestor() const { return totalReturn() - profitToBank(); }
+	double profitToBank() const     { return m_rate * m_initialValue; }
+
+	Bank const& bank() const         { return m_bank; }
+	Investor const& investor() const { return m_investor; }
+	Share const& share() const       { return m_share; }
+	double rate() const              { return m_rate; }
+	double initialValue() const      { return m_initialValue; }
+
+private:
+	Bank const& m_bank;
+	Investor const& m_investor;
+	Share m_share;
+	double m_rate{};
+	double m_initialValue{};
+};
+
+static std::string const& name_of(Bank const& x)     { return x.name; }
+static std::string const& name_of(Investor const& x) { return x.name(); }
+static std::string const& name_of(Company const& x)  { return x.name; }
+
+
+
+// A table of interned values. Every distinct name is stored once, and gets an
+// index. Looking up an index is just an array access.
+//
+// The table keeps its own copy, and the name is the identity. Interning a
+// value with a name that is already there returns the existing index, and the
+// first copy stays, even when the other fields differ. So, a Company whose
+// value changes later must be updated in the table too.
+template <typename T>
+class intern_table {
+public:
+	using id = uint32_t;
+
+	std::optional<id> find(std::string const& name) const
+	{
+		auto it = m_index.find(name);
+		if(it == m_index.end())
+			return std::nullopt;
+		return it->second;
+	}
+
+	id intern(T const& value)
+	{
+		auto it = m_index.find(name_of(value));
+		if(it != m_index.end())
+			return it->second;
+
+		auto i = static_cast<id>(m_values.size());
+		m_values.push_back(value);
+		m_index.emplace(name_of(value), i);
+		return i;
+	}
+
+	T& operator[](id i) { return m_values[i]; }
+	T const& operator[](id i) const { return m_values[i]; }
+	size_t size() const { return m_values.size(); }
+
+private:
+	std::vector<T> m_values;
+	std::unordered_map<std::string, id> m_index;
+};
+
+// A contract in the book: three indices and the numbers. No pointers.
+struct ContractRecord {
+	intern_table<Bank>::id bank;
+	intern_table<Investor>::id investor;
+	intern_table<Company>::id company;
+	double amount;
+	double rate;
+	double initialValue;
+
+	friend bool operator==(ContractRecord const& a, ContractRecord const& b)
+	{
+		return a.bank == b.bank && a.investor == b.investor && a.company == b.company &&
+			a.amount == b.amount && a.rate == b.rate && a.initialValue == b.initialValue;
+	}
+};
+
+struct ContractRecordHash {
+	size_t operator()(ContractRecord const& c) const
+	{
+		size_t h = std::hash<uint64_t>{}((uint64_t{c.bank} << 42U) ^ (uint64_t{c.investor} << 21U) ^ c.company);
+		for(double x : {c.amount, c.rate, c.initialValue})
+			h = h * 31U + std::hash<double>{}(x);
+		return h;
+	}
+};
+
+class ContractBook {
+public:
+	using id = uint32_t;
+
+	// Add a contract. Identical contracts are stored once; only the count
+	// goes up.
+	id add(Contract const& c)
+	{
+		// Check first, such that a rejected contract does not end up
+		// in the intern tables.
+		if(m_sealed)
+			throw std::logic_error{"Book is sealed"};
+
+		ContractRecord r{
+			m_banks.intern(c.bank()),
+			m_investors.intern(c.investor()),
+			m_companies.intern(c.share().company),
+			c.share().amount, c.rate(), c.initialValue()};
+
+		auto it = m_index.find(r);
+		if(it != m_index.end()) {
+			m_multiplicity[it->second]++;
+			return it->second;
+		}
+
+		auto i = static_cast<id>(m_records.size());
+		m_records.push_back(r);
+		m_multiplicity.push_back(1);
+		m_index.emplace(r, i);
+		return i;
+	}
+
+	// The index to find duplicates takes more memory than the records
+	// themselves. When the book is complete, drop it.
+	void seal()
+	{
+		m_index = decltype(m_index){};
+		m_records.shrink_to_fit();
+		m_multiplicity.shrink_to_fit();
+		m_sealed = true;
+	}
+
+	// A Contract refers to the live Company; the book has a copy. Pass
+	// changes of the value on via this function.
+	void set_value(Company const& c)
+	{
+		auto i = m_companies.find(c.name);
+		if(!i)
+			throw std::out_of_range{"Unknown company"};
+		m_companies[*i].value = c.value;
+	}
+
+	// The profit of all contracts, just like walking all Contracts.
+	double total_profit() const
+	{
+		double total = 0;
+		for(size_t i = 0; i < m_records.size(); i++) {
+			auto const& r = m_records[i];
+			double value = m_companies[r.company].value * r.amount;
+			double profit = value - r.initialValue - r.rate * r.initialValue;
+			total += profit * static_cast<double>(m_multiplicity[i]);
+		}
+		return total;
+	}
+
+	size_t unique_contracts() const { return m_records.size(); }
+
+	// Bytes used by the contracts, excluding the interned tables (which
+	// are small) and the index (which is gone after seal()).
+	size_t memory() const
+	{
+		return m_records.capacity() * sizeof(ContractRecord) + m_multiplicity.capacity() * sizeof(uint32_t);
+	}
+
+private:
+	intern_table<Bank> m_banks;
+	intern_table<Investor> m_investors;
+	intern_table<Company> m_companies;
+	std::vector<ContractRecord> m_records;
+	std::vector<uint32_t> m_multiplicity;
+	std::unordered_map<ContractRecord, id, ContractRecordHash> m_index;
+	bool m_sealed{};
+};
+
+static void report(char const* what, size_t n, size_t bytes)
+{
+	std::cout << "  " << what << ": " << static_cast<double>(bytes) / static_cast<double>(n) << " bytes/contract" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	Bank cs{"Credit Suisse"};
+	Bank nmr{"Nomura"};
+	Bank gs{"Goldman Sachs"};
+	Company viac{"ViacomCBS", 27'000'000'000.};
+	Investor bill{"Hwang"};
+
+	// The contracts of 20210412_brace_init.
+	Contract contract1{cs, bill, viac, 1'000'000., 0.01};
+	viac.value *= 1.05;
+	Contract contract2{nmr, bill, viac, 10'000'000., 0.02};
+	Contract contract3{gs, bill, viac, 100'000'000., 0.01};
+	viac.value *= 1.04;
+
+	// Try 10000000 as argument. The default keeps the test quick.
+	size_t n = bench::scale(argc, argv, 100'000);
+
+	// Copy them n / 3 times, like the Year 3 array, and put them in the
+	// book too.
+	std::vector<Contract> contracts;
+	contracts.reserve(n);
+	ContractBook book;
+	for(size_t i = 0; i < n; i++) {
+		auto const& c = i % 3U == 0 ? contract1 : i % 3U == 1 ? contract2 : contract3;
+		contracts.push_back(c);
+		book.add(c);
+	}
+	book.seal();
+
+	// The book has its own copy of the company. Update both.
+	viac.value *= 0.5;
+	book.set_value(viac);
+
+	std::cout << n << " contracts, " << book.unique_contracts() << " unique" << std::endl;
+	report("Contract[]  ", n, contracts.size() * sizeof(Contract));
+	report("ContractBook", n, book.memory());
+	std::cout << "  (sizeof(Contract) = " << sizeof(Contract)
+		<< ", sizeof(ContractRecord) = " << sizeof(ContractRecord) << ")" << std::endl;
+
+	double total_contracts = 0;
+	bench::measure("scan Contract[]", n, [&] {
+		for(auto const& c : contracts)
+			total_contracts += c.profitToInvestor();
+		bench::escape(total_contracts);
+	});
+
+	double total_book = 0;
+	bench::measure("scan ContractBook", n, [&] {
+		total_book = book.total_profit();
+		bench::escape(total_book);
+	});
+
+	std::cout << "  total profit: " << total_contracts << " vs " << total_book << std::endl;
+	if(std::fabs(total_contracts - total_book) > 1e-9 * std::fabs(total_contracts))
+		return 1;
+
+	// That is the best case: only three distinct contracts. When all
+	// contracts are different, there is nothing to deduplicate, but the
+	// record is still smaller and holds no pointers.
+	std::vector<Contract> unique;
+	unique.reserve(n);
+	ContractBook unique_book;
+	for(size_t i = 0; i < n; i++) {
+		unique.emplace_back(cs, bill, viac, 1000.0 + static_cast<double>(i), 0.01);
+		unique_book.add(unique.back());
+	}
+	unique_book.seal();
+
+	std::cout << std::endl << n << " contracts, " << unique_book.unique_contracts() << " unique" << std::endl;
+	report("Contract[]  ", n, unique.size() * sizeof(Contract));
+	report("ContractBook", n, unique_book.memory());
+
+	bench::measure("scan Contract[]", n, [&] {
+		double total = 0;
+		for(auto const& c : unique)
+			total += c.profitToInvestor();
+		bench::escape(total);
+	});
+
+	bench::measure("scan ContractBook", n, [&] {
+		double total = unique_book.total_profit();
+		bench::escape(total);
+	});
+
+	// Indices instead of pointers have more advantages: they are half the
+	// size, they stay valid when the table is reallocated, and you can
+	// write them to a file as is.
+}
+
+/*
+ * Further reading:
+ *
+ * https://en.wikipedia.org/wiki/String_interning
+ * https://en.wikipedia.org/wiki/Flyweight_pattern
+ *
+ * See also 20210412_brace_init for the original contracts.
+ */
@@ -0,0 +1,499 @@
+﻿/*
+ * Enum names
+ *
+ * 20210419_enums ends with a sad note: getting the name of an enumerator is
+ * not possible in C++, not without macros or compiler-specific hacks. So,
+ * every log statement prints "mode = 3", and everyone writes the same switch
+ * to turn it into "Check". Until someone adds an enumerator, and forgets the
+ * switch.
+ *
+ * Let's do the compiler-specific hack. It is quite a neat one: both gcc and
+ * clang print the values of the template arguments in __PRETTY_FUNCTION__,
+ * and when a value of an enum is a named enumerator, they print its name. We
+ * can inspect that string at compile time. Try all values in a range, keep the
+ * ones that have a name, and you have a table of all enumerators, with their
+ * names. No macros, no switch, and it is all done while compiling.
+ *
+ * Scroll down to main() and follow the program flow.
+ */
+
+// These includes are just for this example.
+#include "bench.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+// The enums of 20210419_enums.
+enum Mode {
+	Reset,
+	Idle,
+	PreFlight,
+	Check,
+	Flight,
+};
+
+enum class Test {
+	Deploy,
+	LowSpeed,
+	HighSpeed,
+	Flight,
+};
+
+enum class Speed : uint16_t {
+	Off = 0,
+	LowSpeed = 50,
+	Flight = 2400,
+	HighSpeed = 2537,
+	MaxSpeed = HighSpeed,
+};
+
+// The original is defined in main(), but we need it at namespace scope, as
+// we are going to specialize a template for it below. We also fixed its
+// underlying type; see why below.
+enum Ingenuity : int {
+	Height_cm = 49,
+	Diameter_cm = 120,
+	Mass_g = 1800,
+	SoftwareVersion = 2,
+};
+
+// The probe of an enum in a namespace includes the namespace too.
+namespace mars {
+enum class Rover {
+	Sojourner,
+	Spirit,
+	Opportunity,
+	Curiosity,
+	Perseverance,
+};
+} // namespace mars
+
+
+
+// We can only try values one by one. This is the range that is tried. The
+// default is small, as every value is a template instantiation, which costs
+// compile time. Specialize it for enums with other values.
+template <typename E>
+struct enum_range {
+	static constexpr int min = 0;
+	static constexpr int max = 127;
+};
+
+// Speed goes up to 2537.
+template <>
+struct enum_range<Speed> {
+	static constexpr int min = 0;
+	static constexpr int max = 2559;
+};
+
+template <>
+struct enum_range<Ingenuity> {
+	static constexpr int min = 0;
+	static constexpr int max = 2047;
+};
+
+// Careful with unscoped enums without a fixed underlying type, like Mode. The
+// only valid values of Mode are the ones that fit in the bits that its
+// enumerators need: 0 to 7. Converting 8 to a Mode is undefined behavior, and
+// undefined behavior is not allowed at compile time; recent versions of clang
+// refuse it. That's why Ingenuity got a fixed type.
+template <>
+struct enum_range<Mode> {
+	static constexpr int min = 0;
+	static constexpr int max = 7;
+};
+
+namespace detail {
+
+// This is the hack. For probe<Speed::Flight>(), gcc gives:
+//
+//   constexpr std::string_view detail::probe() [with auto V = Speed::Flight; ...]
+//
+// and clang:
+//
+//   std::string_view detail::probe() [V = Speed::Flight]
+//
+// For a value without a name, both print a cast, like (Speed)3, or
+// (mars::Rover)5 for an enum in a namespace.
+template <auto V>
+constexpr std::string_view probe() noexcept
+{
+	return __PRETTY_FUNCTION__;
+}
+
+constexpr bool is_identifier_start(char c) noexcept
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+constexpr bool is_identifier(std::string_view s) noexcept
+{
+	if(s.empty() || !is_identifier_start(s.front()))
+		return false;
+
+	for(char c : s)
+		if(!is_identifier_start(c) && !(c >= '0' && c <= '9'))
+			return false;
+
+	return true;
+}
+
+// Extract the name from the probe, or return an empty string when the value
+// has no name.
+constexpr std::string_view name_from_probe(std::string_view s) noexcept
+{
+	auto start = s.find("V = ");
+	if(start == std::string_view::npos)
+		return {};
+
+	s.remove_prefix(start + 4U);
+	s = s.substr(0, s.find_first_of(";]"));
+
+	// A cast, like (mars::Rover)5. Check before stripping the scope, as
+	// that would leave Rover)5.
+	if(s.empty() || s.front() == '(')
+		return {};
+
+	// Strip the scope, like Speed:: (and main():: for local enums).
+	auto scope = s.rfind("::");
+	if(scope != std::string_view::npos)
+		s.remove_prefix(scope + 2U);
+
+	if(!is_identifier(s))
+		return {};
+
+	return s;
+}
+
+template <typename E, int I>
+constexpr std::string_view name_of() noexcept
+{
+	return name_from_probe(probe<static_cast<E>(enum_range<E>::min + I)>());
+}
+
+template <typename E, int... I>
+constexpr auto names_of(std::integer_sequence<int, I...>) noexcept
+{
+	return std::array<std::string_view, sizeof...(I)>{name_of<E, I>()...};
+}
+
+// The FNV-1a hash, with a seed. Every seed gives a different hash function; we
+// look for one that does not give collisions for the names of an enum.
+//
+// The low bits of FNV-1a only depend on the low bits of the seed and the
+// characters, so we only get a few different hash functions for the small
+// tables we use. Folding the high bits into the low ones fixes that.
+constexpr uint32_t hash(std::string_view s, uint32_t seed) noexcept
+{
+	uint32_t h = 2166136261U ^ seed;
+	for(char c : s) {
+		h ^= static_cast<unsigned char>(c);
+		h *= 16777619U;
+	}
+	return h ^ (h >> 16U);
+}
+
+// Everything we know about an enum. All members are static constexpr, so all
+// of it is computed by the compiler, and ends up as constant data in the
+// executable. Nothing runs at startup.
+template <typename E>
+struct enum_info {
+	static_assert(std::is_enum_v<E>);
+
+	static constexpr int min = enum_range<E>::min;
+	static constexpr int max = enum_range<E>::max;
+	static_assert(min <= max);
+
+	static constexpr size_t range = static_cast<size_t>(max - min) + 1U;
+
+	// The name of every value in the range, or an empty string.
+	static constexpr auto probes = names_of<E>(std::make_integer_sequence<int, static_cast<int>(range)>{});
+
+	static constexpr size_t count = [] {
+		size_t n = 0;
+		for(auto const& name : probes)
+			if(!name.empty())
+				n++;
+		return n;
+	}();
+
+	// All enumerators, by value. Aliases like Speed::MaxSpeed have the
+	// same value as another enumerator, and only one of them is found.
+	static constexpr std::array<E, count> values = [] {
+		std::array<E, count> a{};
+		size_t n = 0;
+		for(size_t i = 0; i < range; i++)
+			if(!probes[i].empty())
+				a[n++] = static_cast<E>(min + static_cast<int>(i));
+		return a;
+	}();
+
+	static constexpr std::array<std::string_view, count> names = [] {
+		std::array<std::string_view, count> a{};
+		size_t n = 0;
+		for(auto const& name : probes)
+			if(!name.empty())
+				a[n++] = name;
+		return a;
+	}();
+
+	// Value to index in values and names; count for values without a name.
+	// For sparse enums like Speed, this is a big table (2560 entries) for
+	// only four enumerators, but it makes the lookup a single load.
+	using index_type = std::conditional_t<(count < 0xff), uint8_t, uint16_t>;
+
+	static constexpr std::array<index_type, range> indices = [] {
+		std::array<index_type, range> a{};
+		index_type n = 0;
+		for(size_t i = 0; i < range; i++)
+			a[i] = probes[i].empty() ? static_cast<index_type>(count) : n++;
+		return a;
+	}();
+
+	// Name to value by a perfect hash: a table of at least twice the number
+	// of names, and a seed for which all names hash to a different slot.
+	static constexpr size_t slots = [] {
+		size_t n = 1;
+		while(n < 2U * count)
+			n *= 2U;
+		return n;
+	}();
+
+	static constexpr uint32_t seed = [] {
+		for(uint32_t s = 0; s < 10000U; s++) {
+			std::array<bool, slots> used{};
+			bool ok = true;
+			for(auto const& name : names) {
+				auto slot = hash(name, s) & (slots - 1U);
+				ok = ok && !used[slot];
+				used[slot] = true;
+			}
+			if(ok)
+				return s;
+		}
+		return ~uint32_t{};
+	}();
+	static_assert(seed != ~uint32_t{}, "No perfect hash found");
+
+	static constexpr std::array<index_type, slots> hashed = [] {
+		std::array<index_type, slots> a{};
+		for(auto& x : a)
+			x = static_cast<index_type>(count);
+		for(size_t i = 0; i < count; i++)
+			a[hash(names[i], seed) & (slots - 1U)] = static_cast<index_type>(i);
+		return a;
+	}();
+};
+
+} // namespace detail
+
+// The number of named enumerators.
+template <typename E>
+inline constexpr size_t enum_count = detail::enum_info<E>::count;
+
+// All named enumerators, ordered by value.
+template <typename E>
+inline constexpr auto const& enum_values = detail::enum_info<E>::values;
+
+// The index of a value in enum_values, if it has a name.
+template <typename E>
+constexpr std::optional<size_t> enum_index(E value) noexcept
+{
+	using info = detail::enum_info<E>;
+	auto i = static_cast<long long>(value) - info::min;
+	if(i < 0 || i >= static_cast<long long>(info::range))
+		return std::nullopt;
+
+	size_t index = info::indices[static_cast<size_t>(i)];
+	if(index >= info::count)
+		return std::nullopt;
+
+	return index;
+}
+
+// The name of a value, or an empty string if it has none.
+template <typename E>
+constexpr std::string_view enum_name(E value) noexcept
+{
+	auto i = enum_index(value);
+	return i ? detail::enum_info<E>::names[*i] : std::string_view{};
+}
+
+// The value of a name. One hash, and one string compare to check that it
+// really is the name.
+template <typename E>
+constexpr std::optional<E> enum_cast(std::string_view name) noexcept
+{
+	using info = detail::enum_info<E>;
+	if constexpr(info::count == 0) {
+		return std::nullopt;
+	} else {
+		size_t i = info::hashed[detail::hash(name, info::seed) & (info::slots - 1U)];
+		if(i >= info::count || info::names[i] != name)
+			return std::nullopt;
+
+		return info::values[i];
+	}
+}
+
+// Everything above is constexpr, so we can check it at compile time.
+static_assert(enum_count<Mode> == 5);
+static_assert(enum_count<Test> == 4);
+static_assert(enum_count<Speed> == 4);
+static_assert(enum_count<Ingenuity> == 4);
+static_assert(enum_name(Check) == "Check");
+static_assert(enum_name(Test::Flight) == "Flight");
+static_assert(enum_name(Speed::Flight) == "Flight");
+static_assert(enum_name(Speed{2399}).empty());
+static_assert(enum_name(Mass_g) == "Mass_g");
+static_assert(enum_values<Speed>[3] == Speed::HighSpeed);
+static_assert(*enum_index(Speed::LowSpeed) == 1);
+static_assert(enum_cast<Speed>("HighSpeed") == Speed::HighSpeed);
+static_assert(enum_cast<Test>("HighSpeed") == Test::HighSpeed);
+static_assert(enum_cast<Mode>("PreFlight") == PreFlight);
+static_assert(!enum_cast<Mode>("Preflight"));
+static_assert(enum_count<mars::Rover> == 5);
+static_assert(enum_name(mars::Rover::Perseverance) == "Perseverance");
+static_assert(enum_name(mars::Rover{5}).empty());
+static_assert(enum_cast<mars::Rover>("Spirit") == mars::Rover::Spirit);
+
+// This is what we had to write before.
+static char const* speed_name(Speed speed)
+{
+	switch(speed) {
+	case Speed::Off:
+		return "Off";
+	case Speed::LowSpeed:
+		return "LowSpeed";
+	case Speed::Flight:
+		return "Flight";
+	case Speed::HighSpeed:
+		return "HighSpeed";
+	default:
+		return "";
+	}
+}
+
+static std::optional<Speed> speed_cast(std::string_view name)
+{
+	// NOLINTNEXTLINE(readability-else-after-return)
+	if(name == "Off")
+		return Speed::Off;
+	else if(name == "LowSpeed")
+		return Speed::LowSpeed;
+	else if(name == "Flight")
+		return Speed::Flight;
+	else if(name == "HighSpeed" || name == "MaxSpeed")
+		return Speed::HighSpeed;
+	else
+		return std::nullopt;
+}
+
+int main(int argc, char** argv)
+{
+	// Finally, names.
+	Mode mode = Check;
+	std::cout << "mode = " << enum_name(mode) << std::endl;
+
+	Speed speed = Speed::Flight;
+	std::cout << "speed = " << enum_name(speed) << std::endl;
+
+	std::cout << "Test:";
+	for(auto t : enum_values<Test>)
+		std::cout << " " << enum_name(t);
+	std::cout << std::endl;
+
+	std::cout << "Ingenuity:";
+	for(auto i : enum_values<Ingenuity>)
+		std::cout << " " << enum_name(i) << "=" << static_cast<int>(i);
+	std::cout << std::endl;
+
+	// Parse some input, and round-trip all enumerators.
+	for(auto s : enum_values<Speed>)
+		if(enum_cast<Speed>(enum_name(s)) != s)
+			return 1;
+
+	if(enum_cast<Speed>("WarpSpeed"))
+		return 1;
+
+	// Enums in a namespace or in a function have their scope stripped.
+	enum class Instrument { Mastcam, SuperCam, PIXL, SHERLOC, MOXIE };
+	std::cout << "Rover:";
+	for(auto r : enum_values<mars::Rover>)
+		std::cout << " " << enum_name(r);
+	std::cout << std::endl << "Instrument:";
+	for(auto i : enum_values<Instrument>)
+		std::cout << " " << enum_name(i);
+	std::cout << std::endl;
+
+	if(enum_count<mars::Rover> != 5 || enum_count<Instrument> != 5 ||
+		enum_name(Instrument::MOXIE) != "MOXIE" || !enum_name(Instrument{5}).empty())
+		return 1;
+
+	// Now, how fast is it?
+	size_t n = bench::scale(argc, argv, 1'000'000);
+	std::array<Speed, 8> speeds{
+		Speed::Off, Speed::Flight, Speed{2399}, Speed::LowSpeed,
+		Speed::HighSpeed, Speed::Flight, Speed{1}, Speed::Off};
+	std::array<std::string_view, 8> inputs{
+		"Off", "Flight", "WarpSpeed", "LowSpeed",
+		"HighSpeed", "Flight", "off", "MaxSpeed"};
+
+	std::cout << std::endl;
+
+	bench::measure("name, switch", n, [&] {
+		for(size_t i = 0; i < n; i++)
+			bench::escape(speed_name(speeds[i % speeds.size()]));
+	});
+
+	bench::measure("name, enum_name", n, [&] {
+		for(size_t i = 0; i < n; i++)
+			bench::escape(enum_name(speeds[i % speeds.size()]));
+	});
+
+	bench::measure("parse, if-chain", n, [&] {
+		for(size_t i = 0; i < n; i++)
+			bench::escape(speed_cast(inputs[i % inputs.size()]));
+	});
+
+	bench::measure("parse, enum_cast", n, [&] {
+		for(size_t i = 0; i < n; i++)
+			bench::escape(enum_cast<Speed>(inputs[i % inputs.size()]));
+	});
+
+	// A hash map is what you would write otherwise, but it must be filled
+	// at startup, and it allocates.
+	std::unordered_map<std::string_view, Speed> map;
+	for(auto s : enum_values<Speed>)
+		map.emplace(enum_name(s), s);
+
+	bench::measure("parse, unordered_map", n, [&] {
+		for(size_t i = 0; i < n; i++) {
+			auto it = map.find(inputs[i % inputs.size()]);
+			bench::escape(it);
+		}
+	});
+
+	// Note that MaxSpeed is not found; it is an alias for HighSpeed, and
+	// the compiler only gives one name per value. The price of this trick
+	// is compile time: every value in the range is a template
+	// instantiation. Keep the ranges small.
+}
+
+/*
+ * Further reading:
+ *
+ * https://gcc.gnu.org/onlinedocs/gcc/Function-Names.html
+ * https://en.wikipedia.org/wiki/Perfect_hash_function
+ * https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function
+ *
+ * See also 20210419_enums and 20210510_constexpr.
+ */
@@ -0,0 +1,362 @@
+﻿/*
+ * State machines
+ *
+ * 20210419_enums has an operator^ that sets the Speed based on a Test, by a
+ * switch. And the Mode is moved forward by casting it to an int, adding one,
+ * and casting it back. Both are little state machines, but you have to read
+ * the code to find out which transitions exist, and nothing stops you from
+ * casting Flight + 1 into a Mode.
+ *
+ * A state machine is nothing more than a table: for every state and every
+ * event, what is the next state, and what should be done? If we write it as
+ * a table, the compiler can check it, the reader can read it, and the CPU
+ * can look up a transition without a single branch.
+ *
+ * Scroll down to main() and follow the program flow.
+ */
+
+// These includes are just for this example.
+#include "bench.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// The enums of 20210419_enums.
+enum Mode {
+	Reset,
+	Idle,
+	PreFlight,
+	Check,
+	Flight,
+};
+
+enum class Test {
+	Deploy,
+	LowSpeed,
+	HighSpeed,
+	Flight,
+};
+
+enum class Speed : uint16_t {
+	Off = 0,
+	LowSpeed = 50,
+	Flight = 2400,
+	HighSpeed = 2537,
+	MaxSpeed = HighSpeed,
+};
+
+// The state machine below needs the number of states and events. C++ cannot
+// tell (but see 20211115_enum_names), so we specify it.
+template <typename E>
+struct enum_size;
+
+template <>
+struct enum_size<Mode> : std::integral_constant<size_t, Flight + 1> {};
+
+template <>
+struct enum_size<Test> : std::integral_constant<size_t, static_cast<size_t>(Test::Flight) + 1U> {};
+
+
+
+// One row of the table as you write it: in state from, on event on, go to
+// state to and do action. Actions are just numbers; what they mean is up to
+// you. Action 0 is reserved: that is what an invalid transition does.
+template <typename State, typename Event>
+struct transition {
+	State from;
+	Event on;
+	State to;
+	uint8_t action;
+};
+
+// The compiled table: an entry for every state and every event. The states and
+// events are expected to be dense, starting at 0, like Mode and Test.
+template <typename State, typename Event>
+class transition_table {
+public:
+	static constexpr size_t states = enum_size<State>::value;
+	static constexpr size_t events = enum_size<Event>::value;
+	static constexpr uint8_t rejected = 0;
+
+	struct entry {
+		State next;
+		uint8_t action;
+	};
+
+	// Build the table. This is meant to be done at compile time. Throwing
+	// an exception is not a constant expression, so when the table is
+	// constexpr, any mistake becomes a compile error.
+	template <size_t N>
+	constexpr explicit transition_table(std::array<transition<State, Event>, N> const& transitions)
+		: m_table{}
+	{
+		// By default, an event does not change the state, and does
+		// action 0.
+		for(size_t s = 0; s < states; s++)
+			for(size_t e = 0; e < events; e++)
+				m_table[s * events + e] = {static_cast<State>(s), rejected};
+
+		for(auto const& t : transitions) {
+			if(index(t.from) >= states || index(t.to) >= states || index(t.on) >= events)
+				throw std::out_of_range{"Unknown state or event"};
+			if(t.action == rejected)
+				throw std::invalid_argument{"Action 0 is reserved"};
+
+			auto& e = m_table[index(t.from) * events + index(t.on)];
+			if(e.action != rejected)
+				throw std::logic_error{"Duplicate transition"};
+
+			e = {t.to, t.action};
+		}
+	}
+
+	// Look up a transition. No branches, just an index computation and a
+	// load.
+	constexpr entry operator()(State state, Event event) const noexcept
+	{
+		return m_table[index(state) * events + index(event)];
+	}
+
+	constexpr bool allowed(State state, Event event) const noexcept
+	{
+		return (*this)(state, event).action != rejected;
+	}
+
+	// Step many independent machines at once: machine i gets event
+	// events[i]. The action of every step is written to actions. There is
+	// no dependency between iterations, so the CPU can do many lookups in
+	// parallel.
+	void step(State* state, Event const* event, uint8_t* action, size_t n) const noexcept
+	{
+		for(size_t i = 0; i < n; i++) {
+			auto e = m_table[index(state[i]) * events + index(event[i])];
+			state[i] = e.next;
+			action[i] = e.action;
+		}
+	}
+
+private:
+	template <typename E>
+	static constexpr size_t index(E e) noexcept
+	{
+		return static_cast<size_t>(e);
+	}
+
+	std::array<entry, states * events> m_table;
+};
+
+// A single machine, which only holds its state and a reference to the table.
+template <typename State, typename Event>
+class state_machine {
+public:
+	using table_type = transition_table<State, Event>;
+
+	constexpr state_machine(table_type const& table, State initial) noexcept
+		: m_table{&table}
+		, m_state{initial}
+	{}
+
+	// Handle an event, and return the action to do.
+	constexpr uint8_t operator()(Event event) noexcept
+	{
+		auto e = (*m_table)(m_state, event);
+		m_state = e.next;
+		return e.action;
+	}
+
+	constexpr State state() const noexcept { return m_state; }
+
+private:
+	table_type const* m_table;
+	State m_state;
+};
+
+// Now, the actual machine. The actions set the Speed, like operator^ of
+// 20210419_enums does.
+enum Action : uint8_t {
+	Rejected = transition_table<Mode, Test>::rejected,
+	SpinOff,
+	SpinLow,
+	SpinHigh,
+	SpinFlight,
+};
+
+static constexpr std::array<Speed, 5> action_speed{
+	Speed::Off, Speed::Off, Speed::LowSpeed, Speed::HighSpeed, Speed::Flight};
+
+static constexpr transition_table<Mode, Test> ingenuity{std::array<transition<Mode, Test>, 10>{{
+	// from       event             to          action
+	{Reset,     Test::Deploy,    Idle,       SpinOff},
+	{Idle,      Test::LowSpeed,  PreFlight,  SpinLow},
+	{Idle,      Test::Deploy,    Reset,      SpinOff},
+	{PreFlight, Test::HighSpeed, Check,      SpinHigh},
+	{PreFlight, Test::Deploy,    Idle,       SpinOff},
+	{Check,     Test::Flight,    Flight,     SpinFlight},
+	{Check,     Test::LowSpeed,  PreFlight,  SpinLow},
+	{Check,     Test::Deploy,    Idle,       SpinOff},
+	{Flight,    Test::HighSpeed, Flight,     SpinHigh},
+	{Flight,    Test::LowSpeed,  Idle,       SpinLow},
+}}};
+
+// As the table is constexpr, we can test it at compile time. And if you add
+// the same transition twice, or use action 0, it does not compile.
+static_assert(ingenuity.allowed(Reset, Test::Deploy));
+static_assert(!ingenuity.allowed(Reset, Test::Flight));
+static_assert(ingenuity(Check, Test::Flight).next == Flight);
+static_assert(ingenuity(Flight, Test::Deploy).next == Flight);
+
+// Even a whole flight can be checked at compile time.
+static constexpr Mode fly()
+{
+	state_machine<Mode, Test> m{ingenuity, Reset};
+	for(auto e : {Test::Deploy, Test::LowSpeed, Test::HighSpeed, Test::Flight})
+		m(e);
+	return m.state();
+}
+
+static_assert(fly() == Flight);
+
+// This is the same machine, written as a switch.
+static std::pair<Mode, uint8_t> step_switch(Mode mode, Test test)
+{
+	switch(mode) {
+	case Reset:
+		if(test == Test::Deploy)
+			return {Idle, SpinOff};
+		break;
+	case Idle:
+		switch(test) {
+		case Test::LowSpeed: return {PreFlight, SpinLow};
+		case Test::Deploy:   return {Reset, SpinOff};
+		default:             break;
+		}
+		break;
+	case PreFlight:
+		switch(test) {
+		case Test::HighSpeed: return {Check, SpinHigh};
+		case Test::Deploy:    return {Idle, SpinOff};
+		default:              break;
+		}
+		break;
+	case Check:
+		switch(test) {
+		case Test::Flight:   return {Flight, SpinFlight};
+		case Test::LowSpeed: return {PreFlight, SpinLow};
+		case Test::Deploy:   return {Idle, SpinOff};
+		default:             break;
+		}
+		break;
+	case Flight:
+		switch(test) {
+		case Test::HighSpeed: return {Flight, SpinHigh};
+		case Test::LowSpeed:  return {Idle, SpinLow};
+		default:              break;
+		}
+		break;
+	}
+	return {mode, Rejected};
+}
+
+int main(int argc, char** argv)
+{
+	// Fly, and try something stupid halfway.
+	state_machine<Mode, Test> m{ingenuity, Reset};
+	Speed speed = Speed::Off;
+
+	for(auto e : {Test::Deploy, Test::LowSpeed, Test::Flight, Test::HighSpeed, Test::Flight}) {
+		auto action = m(e);
+		if(action == Rejected)
+			std::cout << "rejected event " << static_cast<int>(e) << " in mode " << m.state() << std::endl;
+		else
+			speed = action_speed[action];
+	}
+
+	std::cout << "mode = " << m.state() << ", speed = " << static_cast<int>(speed) << std::endl;
+	if(m.state() != Flight || speed != Speed::Flight)
+		return 1;
+
+	// Random events. Most of them are rejected, which is the worst case for
+	// a switch: the CPU cannot predict which case is taken.
+	size_t n = bench::scale(argc, argv, 1'000'000);
+	std::vector<Test> events(n);
+	uint32_t x = 1;
+	for(auto& e : events) {
+		x = x * 1664525U + 1013904223U;
+		e = static_cast<Test>(x >> 30U);
+	}
+
+	std::cout << std::endl << n << " transitions:" << std::endl;
+
+	// First, one machine. Every step depends on the previous one.
+	unsigned sum_switch = 0;
+	bench::measure("one machine, switch", n, [&] {
+		Mode mode = Reset;
+		for(auto e : events) {
+			auto [next, action] = step_switch(mode, e);
+			mode = next;
+			sum_switch += action;
+		}
+		bench::escape(mode);
+	});
+
+	unsigned sum_table = 0;
+	bench::measure("one machine, table", n, [&] {
+		state_machine<Mode, Test> machine{ingenuity, Reset};
+		for(auto e : events)
+			sum_table += machine(e);
+		bench::escape(machine);
+	});
+
+	if(sum_switch != sum_table)
+		return 1;
+
+	// Now, many independent machines, like a fleet of helicopters. Every
+	// machine gets one event per round.
+	size_t const fleet = 1024;
+	size_t rounds = n / fleet;
+	std::vector<Mode> modes(fleet, Reset);
+	std::vector<uint8_t> actions(fleet);
+
+	bench::measure("fleet, switch", rounds * fleet, [&] {
+		for(size_t r = 0; r < rounds; r++) {
+			Test const* e = events.data() + r * fleet;
+			for(size_t i = 0; i < fleet; i++) {
+				auto [next, action] = step_switch(modes[i], e[i]);
+				modes[i] = next;
+				actions[i] = action;
+			}
+		}
+		bench::escape(actions);
+	});
+
+	auto modes_switch = modes;
+	std::fill(modes.begin(), modes.end(), Reset);
+
+	bench::measure("fleet, table", rounds * fleet, [&] {
+		for(size_t r = 0; r < rounds; r++)
+			ingenuity.step(modes.data(), events.data() + r * fleet, actions.data(), fleet);
+		bench::escape(actions);
+	});
+
+	if(modes != modes_switch)
+		return 1;
+
+	// The switch is not bad when events are predictable. With
+	// unpredictable input, every mispredicted branch costs a dozen or so
+	// cycles, and the table lookup wins. And the table is easier to read.
+}
+
+/*
+ * Further reading:
+ *
+ * https://en.wikipedia.org/wiki/State-transition_table
+ * https://en.wikipedia.org/wiki/Finite-state_machine
+ *
+ * See also 20210419_enums and 20210510_constexpr.
+ */
@@ -0,0 +1,488 @@
+﻿/*
+ * Enum containers
+ *
+ * Once you have an enum, you will want to associate something with its
+ * values: a counter per Mode, a description per Test, a limit per Speed. The
+ * first thing that comes to mind is std::map<Mode, X>, or std::unordered_map.
+ * These work, but they allocate a node per element, and every lookup is a
+ * tree walk or a hash computation. For a handful of known keys, that is a lot
+ * of work.
+ *
+ * The keys of an enum are known at compile time. So, we know exactly how
+ * much room we need, and where every key goes: an array, indexed by the
+ * position of the enumerator in its declaration. A set of enumerators is even
+ * simpler: one bit per enumerator.
+ *
+ * Scroll down to main() and follow the program flow.
+ */
+
+// These includes are just for this example.
+#include "bench.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// The enums of 20210419_enums.
+enum Mode {
+	Reset,
+	Idle,
+	PreFlight,
+	Check,
+	Flight,
+};
+
+enum class Test {
+	Deploy,
+	LowSpeed,
+	HighSpeed,
+	Flight,
+};
+
+enum class Speed : uint16_t {
+	Off = 0,
+	LowSpeed = 50,
+	Flight = 2400,
+	HighSpeed = 2537,
+	MaxSpeed = HighSpeed,
+};
+
+// The containers need to know the enumerators, in declaration order. C++ does
+// not tell us, so we list them. (With gcc or clang, 20211115_enum_names shows
+// how to find them automatically.)
+template <typename E>
+struct enum_traits;
+
+template <>
+struct enum_traits<Mode> {
+	static constexpr std::array values{Reset, Idle, PreFlight, Check, Flight};
+};
+
+template <>
+struct enum_traits<Test> {
+	static constexpr std::array values{Test::Deploy, Test::LowSpeed, Test::HighSpeed, Test::Flight};
+};
+
+// MaxSpeed is an alias, not a separate key.
+template <>
+struct enum_traits<Speed> {
+	static constexpr std::array values{Speed::Off, Speed::LowSpeed, Speed::Flight, Speed::HighSpeed};
+};
+
+
+
+// Everything else is derived from the list: the position (ordinal) of every
+// value, and the mapping from a value to its ordinal.
+template <typename E>
+struct enum_ordinal {
+	static constexpr auto const& values = enum_traits<E>::values;
+	static constexpr size_t count = values.size();
+
+	using underlying = std::underlying_type_t<E>;
+
+	static constexpr long long value(E e) noexcept
+	{
+		return static_cast<long long>(static_cast<underlying>(e));
+	}
+
+	static constexpr long long min = [] {
+		long long m = value(values[0]);
+		for(auto v : values)
+			m = value(v) < m ? value(v) : m;
+		return m;
+	}();
+
+	static constexpr long long max = [] {
+		long long m = value(values[0]);
+		for(auto v : values)
+			m = value(v) > m ? value(v) : m;
+		return m;
+	}();
+
+	// Enums like Mode are dense: the value is the ordinal.
+	static constexpr bool dense = [] {
+		for(size_t i = 0; i < count; i++)
+			if(value(values[i]) != static_cast<long long>(i))
+				return false;
+		return true;
+	}();
+
+	// Enums like Speed are sparse. If the range is not too large, a lookup
+	// table maps the value to the ordinal. That costs some memory (2.5 kB for
+	// Speed), but it is a single load.
+	static constexpr size_t range = static_cast<size_t>(max - min) + 1U;
+	static constexpr size_t table_size = dense || range > 0x10000U ? 1U : range;
+
+	static constexpr std::array<uint8_t, table_size> table = [] {
+		static_assert(count < 0xff, "Too many enumerators");
+		std::array<uint8_t, table_size> t{};
+		for(auto& x : t)
+			x = static_cast<uint8_t>(count);
+		if(table_size > 1U)
+			for(size_t i = 0; i < count; i++)
+				t[static_cast<size_t>(value(values[i]) - min)] = static_cast<uint8_t>(i);
+		return t;
+	}();
+
+	// The ordinal of e, or count if e is not an enumerator.
+	static constexpr size_t of(E e) noexcept
+	{
+		auto v = value(e);
+		if constexpr(dense) {
+			return v >= 0 && v < static_cast<long long>(count) ? static_cast<size_t>(v) : count;
+		} else if constexpr(table_size > 1U) {
+			return v >= min && v <= max ? table[static_cast<size_t>(v - min)] : count;
+		} else {
+			for(size_t i = 0; i < count; i++)
+				if(values[i] == e)
+					return i;
+			return count;
+		}
+	}
+};
+
+// A map with a value for every enumerator. There is no insert or erase; every
+// key is always there.
+template <typename E, typename V>
+class enum_map {
+public:
+	using ordinal = enum_ordinal<E>;
+	using key_type = E;
+	using mapped_type = V;
+
+	constexpr enum_map() = default;
+
+	constexpr enum_map(std::initializer_list<std::pair<E, V>> init)
+	{
+		for(auto const& kv : init)
+			at(kv.first) = kv.second;
+	}
+
+	// Like std::array, operator[] does not check.
+	constexpr V& operator[](E key) noexcept { return m_values[ordinal::of(key)]; }
+	constexpr V const& operator[](E key) const noexcept { return m_values[ordinal::of(key)]; }
+
+	constexpr V& at(E key)
+	{
+		auto i = ordinal::of(key);
+		if(i >= ordinal::count)
+			throw std::out_of_range{"Not an enumerator"};
+		return m_values[i];
+	}
+
+	constexpr V const& at(E key) const
+	{
+		auto i = ordinal::of(key);
+		if(i >= ordinal::count)
+			throw std::out_of_range{"Not an enumerator"};
+		return m_values[i];
+	}
+
+	static constexpr size_t size() noexcept { return ordinal::count; }
+
+	// Iteration gives pairs of the key and a reference to the value, in
+	// declaration order. for(auto [key, value] : map) works.
+	template <typename Ref>
+	class iterator_t {
+	public:
+		constexpr iterator_t(Ref* values, size_t i) noexcept : m_values{values}, m_i{i} {}
+		constexpr std::pair<E, Ref&> operator*() const noexcept { return {ordinal::values[m_i], m_values[m_i]}; }
+		constexpr iterator_t& operator++() noexcept { m_i++; return *this; }
+		constexpr bool operator!=(iterator_t const& other) const noexcept { return m_i != other.m_i; }
+		constexpr bool operator==(iterator_t const& other) const noexcept { return m_i == other.m_i; }
+
+	private:
+		Ref* m_values;
+		size_t m_i;
+	};
+
+	using iterator = iterator_t<V>;
+	using const_iterator = iterator_t<V const>;
+
+	constexpr iterator begin() noexcept { return {m_values.data(), 0}; }
+	constexpr iterator end() noexcept { return {m_values.data(), size()}; }
+	constexpr const_iterator begin() const noexcept { return {m_values.data(), 0}; }
+	constexpr const_iterator end() const noexcept { return {m_values.data(), size()}; }
+
+	// All values, in declaration order of the keys.
+	constexpr std::array<V, ordinal::count>& values() noexcept { return m_values; }
+	constexpr std::array<V, ordinal::count> const& values() const noexcept { return m_values; }
+
+private:
+	std::array<V, ordinal::count> m_values{};
+};
+
+// A set of enumerators: one bit per enumerator.
+template <typename E>
+class enum_set {
+public:
+	using ordinal = enum_ordinal<E>;
+	using word = uint64_t;
+	static constexpr size_t bits = 64;
+	static constexpr size_t words = (ordinal::count + bits - 1U) / bits;
+
+	constexpr enum_set() noexcept = default;
+
+	constexpr enum_set(std::initializer_list<E> init) noexcept
+	{
+		for(auto e : init)
+			insert(e);
+	}
+
+	constexpr void insert(E e) noexcept
+	{
+		auto i = ordinal::of(e);
+		if(i < ordinal::count)
+			m_words[i / bits] |= word{1} << (i % bits);
+	}
+
+	constexpr void erase(E e) noexcept
+	{
+		auto i = ordinal::of(e);
+		if(i < ordinal::count)
+			m_words[i / bits] &= ~(word{1} << (i % bits));
+	}
+
+	constexpr bool contains(E e) const noexcept
+	{
+		auto i = ordinal::of(e);
+		return i < ordinal::count && ((m_words[i / bits] >> (i % bits)) & 1U) != 0;
+	}
+
+	constexpr size_t size() const noexcept
+	{
+		size_t n = 0;
+		for(auto w : m_words)
+			for(; w != 0; w &= w - 1U)
+				n++;
+		return n;
+	}
+
+	constexpr bool empty() const noexcept
+	{
+		word any = 0;
+		for(auto w : m_words)
+			any |= w;
+		return any == 0;
+	}
+
+	constexpr enum_set& operator|=(enum_set const& other) noexcept
+	{
+		for(size_t i = 0; i < words; i++)
+			m_words[i] |= other.m_words[i];
+		return *this;
+	}
+
+	constexpr enum_set& operator&=(enum_set const& other) noexcept
+	{
+		for(size_t i = 0; i < words; i++)
+			m_words[i] &= other.m_words[i];
+		return *this;
+	}
+
+	friend constexpr enum_set operator|(enum_set a, enum_set const& b) noexcept { return a |= b; }
+	friend constexpr enum_set operator&(enum_set a, enum_set const& b) noexcept { return a &= b; }
+
+	friend constexpr bool operator==(enum_set const& a, enum_set const& b) noexcept
+	{
+		for(size_t i = 0; i < words; i++)
+			if(a.m_words[i] != b.m_words[i])
+				return false;
+		return true;
+	}
+
+	friend constexpr bool operator!=(enum_set const& a, enum_set const& b) noexcept { return !(a == b); }
+
+	// Iterate over the enumerators in the set, in declaration order.
+	class iterator {
+	public:
+		constexpr iterator(enum_set const* set, size_t i) noexcept : m_set{set}, m_i{i} { skip(); }
+		constexpr E operator*() const noexcept { return ordinal::values[m_i]; }
+		constexpr iterator& operator++() noexcept { m_i++; skip(); return *this; }
+		constexpr bool operator!=(iterator const& other) const noexcept { return m_i != other.m_i; }
+		constexpr bool operator==(iterator const& other) const noexcept { return m_i == other.m_i; }
+
+	private:
+		constexpr void skip() noexcept
+		{
+			while(m_i < ordinal::count && ((m_set->m_words[m_i / bits] >> (m_i % bits)) & 1U) == 0)
+				m_i++;
+		}
+
+		enum_set const* m_set;
+		size_t m_i;
+	};
+
+	constexpr iterator begin() const noexcept { return {this, 0}; }
+	constexpr iterator end() const noexcept { return {this, ordinal::count}; }
+
+	// Bulk operations on arrays of sets: out[i] = a[i] | b[i]. These are
+	// plain loops over words, without any branch, which compilers turn into
+	// vector instructions.
+	static void unite(enum_set* out, enum_set const* a, enum_set const* b, size_t n) noexcept
+	{
+		for(size_t i = 0; i < n; i++)
+			for(size_t w = 0; w < words; w++)
+				out[i].m_words[w] = a[i].m_words[w] | b[i].m_words[w];
+	}
+
+	static void intersect(enum_set* out, enum_set const* a, enum_set const* b, size_t n) noexcept
+	{
+		for(size_t i = 0; i < n; i++)
+			for(size_t w = 0; w < words; w++)
+				out[i].m_words[w] = a[i].m_words[w] & b[i].m_words[w];
+	}
+
+private:
+	std::array<word, words> m_words{};
+};
+
+// All of it works at compile time.
+static constexpr enum_map<Speed, std::string_view> speed_names{
+	{Speed::Off, "off"}, {Speed::LowSpeed, "low"}, {Speed::Flight, "flight"}, {Speed::HighSpeed, "high"}};
+
+static_assert(speed_names[Speed::Flight] == "flight");
+static_assert(speed_names[Speed::MaxSpeed] == "high");
+static_assert(enum_ordinal<Speed>::of(Speed::Flight) == 2);
+static_assert(enum_ordinal<Speed>::of(Speed{2399}) == 4);
+static_assert(enum_ordinal<Mode>::dense);
+static_assert(!enum_ordinal<Speed>::dense);
+
+static constexpr enum_set<Test> spinning{Test::LowSpeed, Test::HighSpeed, Test::Flight};
+static constexpr enum_set<Test> fast{Test::HighSpeed, Test::Flight};
+static_assert((spinning & fast) == fast);
+static_assert((fast | enum_set<Test>{Test::Deploy}).size() == 3);
+static_assert(!spinning.contains(Test::Deploy));
+static_assert(*spinning.begin() == Test::LowSpeed);
+
+int main(int argc, char** argv)
+{
+	// Count how often the helicopter was in each mode.
+	enum_map<Mode, unsigned> visits;
+	for(auto m : {Reset, Idle, PreFlight, Check, Flight, Idle, PreFlight, Check, Flight})
+		visits[m]++;
+
+	for(auto [mode, count] : visits)
+		std::cout << "mode " << mode << ": " << count << std::endl;
+
+	for(auto [speed, name] : speed_names)
+		std::cout << name << " = " << static_cast<int>(speed) << std::endl;
+
+	if(visits[Flight] != 2 || visits.at(Reset) != 1)
+		return 1;
+
+	// Now, compare with the standard maps.
+	size_t n = bench::scale(argc, argv, 1'000'000);
+	std::vector<Speed> keys(n);
+	uint32_t x = 1;
+	for(auto& k : keys) {
+		x = x * 1664525U + 1013904223U;
+		k = enum_traits<Speed>::values[x >> 30U];
+	}
+
+	std::map<Speed, double> map;
+	std::unordered_map<Speed, double> umap;
+	enum_map<Speed, double> emap;
+	for(auto s : enum_traits<Speed>::values) {
+		map[s] = static_cast<double>(s);
+		umap[s] = static_cast<double>(s);
+		emap[s] = static_cast<double>(s);
+	}
+
+	std::cout << std::endl << n << " lookups:" << std::endl;
+
+	double sum_map = 0;
+	bench::measure("std::map", n, [&] {
+		for(auto k : keys)
+			sum_map += map.find(k)->second;
+		bench::escape(sum_map);
+	});
+
+	double sum_umap = 0;
+	bench::measure("std::unordered_map", n, [&] {
+		for(auto k : keys)
+			sum_umap += umap.find(k)->second;
+		bench::escape(sum_umap);
+	});
+
+	double sum_emap = 0;
+	bench::measure("enum_map", n, [&] {
+		for(auto k : keys)
+			sum_emap += emap[k];
+		bench::escape(sum_emap);
+	});
+
+	if(sum_map != sum_emap || sum_umap != sum_emap)
+		return 1;
+
+	std::cout << std::endl << n << " iterations over all elements:" << std::endl;
+	size_t rounds = n / enum_traits<Speed>::values.size();
+
+	bench::measure("std::map", rounds * map.size(), [&] {
+		double sum = 0;
+		for(size_t r = 0; r < rounds; r++)
+			for(auto const& kv : map)
+				sum += kv.second;
+		bench::escape(sum);
+	});
+
+	bench::measure("std::unordered_map", rounds * umap.size(), [&] {
+		double sum = 0;
+		for(size_t r = 0; r < rounds; r++)
+			for(auto const& kv : umap)
+				sum += kv.second;
+		bench::escape(sum);
+	});
+
+	bench::measure("enum_map", rounds * emap.size(), [&] {
+		double sum = 0;
+		for(size_t r = 0; r < rounds; r++)
+			for(auto [key, value] : emap)
+				sum += value;
+		bench::escape(sum);
+	});
+
+	// And sets. Every helicopter in a fleet has a set of tests it passed;
+	// which tests did each pass on both days?
+	std::vector<enum_set<Test>> day1(n);
+	std::vector<enum_set<Test>> day2(n);
+	std::vector<enum_set<Test>> both(n);
+	for(size_t i = 0; i < n; i++) {
+		day1[i].insert(static_cast<Test>(i % 4U));
+		day1[i].insert(static_cast<Test>(i % 3U));
+		day2[i].insert(static_cast<Test>(i % 2U));
+	}
+
+	std::cout << std::endl << n << " sets:" << std::endl;
+
+	bench::measure("enum_set intersect", n, [&] {
+		enum_set<Test>::intersect(both.data(), day1.data(), day2.data(), n);
+		bench::escape(both);
+	});
+
+	bench::measure("enum_set unite", n, [&] {
+		enum_set<Test>::unite(both.data(), day1.data(), day2.data(), n);
+		bench::escape(both);
+	});
+
+	// No allocations, no hashing, no tree. The price is that the keys must
+	// be known at compile time, which for enums, they are.
+}
+
+/*
+ * Further reading:
+ *
+ * https://en.cppreference.com/w/cpp/utility/bitset
+ * https://docs.oracle.com/javase/8/docs/api/java/util/EnumMap.html
+ *
+ * See also 20210419_enums and 20211115_enum_names.
+ */
@@ -0,0 +1,278 @@
+﻿/*
+ * Bit packing
+ *
+ * Say that the helicopter of 20210419_enums logs its Mode, Test and Speed a
+ * thousand times per second. A struct with these three takes 12 bytes: Mode
+ * and Test are ints, Speed is an uint16_t, and there are two bytes of padding.
+ * But Mode only has 5 values, which fit in 3 bits. Test fits in 2 bits, and
+ * Speed goes up to 2537, which fits in 12 bits. That is 17 bits, not 96.
+ *
+ * C++ has bit-fields, but their layout is up to the compiler, so you cannot
+ * use them for a file format or a radio link. Let's pack the bits ourselves,
+ * and let the compiler compute how many bits every field needs.
+ *
+ * Scroll down to main() and follow the program flow.
+ */
+
+// These includes are just for this example.
+#include "bench.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+// The enums of 20210419_enums.
+enum Mode {
+	Reset,
+	Idle,
+	PreFlight,
+	Check,
+	Flight,
+};
+
+enum class Test {
+	Deploy,
+	LowSpeed,
+	HighSpeed,
+	Flight,
+};
+
+enum class Speed : uint16_t {
+	Off = 0,
+	LowSpeed = 50,
+	Flight = 2400,
+	HighSpeed = 2537,
+	MaxSpeed = HighSpeed,
+};
+
+// The range of values of every field. Speed is used as a number (2399_rpm),
+// so all values up to MaxSpeed must fit, not only the enumerators.
+template <typename E>
+struct field_range;
+
+template <>
+struct field_range<Mode> {
+	static constexpr Mode min = Reset;
+	static constexpr Mode max = Flight;
+};
+
+template <>
+struct field_range<Test> {
+	static constexpr Test min = Test::Deploy;
+	static constexpr Test max = Test::Flight;
+};
+
+template <>
+struct field_range<Speed> {
+	static constexpr Speed min = Speed::Off;
+	static constexpr Speed max = Speed::MaxSpeed;
+};
+
+// This is how we would normally store it.
+struct Sample {
+	Mode mode;
+	Test test;
+	Speed speed;
+};
+
+
+
+// The number of bits required to store the values 0 to x.
+constexpr unsigned bit_width(unsigned long long x) noexcept
+{
+	unsigned n = 0;
+	for(; x != 0; x >>= 1U)
+		n++;
+	return n;
+}
+
+static_assert(bit_width(0) == 0);
+static_assert(bit_width(4) == 3);
+static_assert(bit_width(2537) == 12);
+
+// A record of the given fields, packed in a single 32 or 64-bit word. Field i
+// is stored as its value minus its minimum, in bits offset[i] to offset[i] +
+// width[i]. The first field is in the least significant bits.
+template <typename... Fields>
+class packed_record {
+public:
+	static constexpr size_t fields = sizeof...(Fields);
+
+	template <size_t I>
+	using field = std::tuple_element_t<I, std::tuple<Fields...>>;
+
+	static constexpr std::array<long long, fields> min{
+		static_cast<long long>(field_range<Fields>::min)...};
+
+	static constexpr std::array<unsigned, fields> width{
+		bit_width(static_cast<unsigned long long>(
+			static_cast<long long>(field_range<Fields>::max) -
+			static_cast<long long>(field_range<Fields>::min)))...};
+
+	static constexpr std::array<unsigned, fields> offset = [] {
+		std::array<unsigned, fields> a{};
+		unsigned o = 0;
+		for(size_t i = 0; i < fields; i++) {
+			a[i] = o;
+			o += width[i];
+		}
+		return a;
+	}();
+
+	static constexpr unsigned bits = [] {
+		unsigned b = 0;
+		for(auto w : width)
+			b += w;
+		return b;
+	}();
+
+	static_assert(bits <= 64, "Record does not fit in 64 bits");
+
+	using word = std::conditional_t<(bits <= 32), uint32_t, uint64_t>;
+
+	// Shifting a 64-bit value by 64 is undefined, so a field of 64 bits
+	// gets all bits directly.
+	template <size_t I>
+	static constexpr word mask = width[I] >= 64U
+		? static_cast<word>(~uint64_t{0})
+		: static_cast<word>((uint64_t{1} << width[I]) - 1U);
+
+	// Pack all fields. Only shifts, masks and ors; no branches.
+	static constexpr word pack(Fields... f) noexcept
+	{
+		return pack(std::index_sequence_for<Fields...>{}, f...);
+	}
+
+	// Extract one field.
+	template <size_t I>
+	static constexpr field<I> get(word w) noexcept
+	{
+		auto v = static_cast<long long>((w >> offset[I]) & mask<I>) + min[I];
+		return static_cast<field<I>>(v);
+	}
+
+	static constexpr std::tuple<Fields...> unpack(word w) noexcept
+	{
+		return unpack(w, std::index_sequence_for<Fields...>{});
+	}
+
+	// Extract one field of many records at once, into a column. The same
+	// shift and mask for every record: easy to vectorize.
+	template <size_t I>
+	static void decode(word const* in, field<I>* out, size_t n) noexcept
+	{
+		for(size_t i = 0; i < n; i++)
+			out[i] = get<I>(in[i]);
+	}
+
+private:
+	template <size_t... I>
+	static constexpr word pack(std::index_sequence<I...>, Fields... f) noexcept
+	{
+		return static_cast<word>(
+			(((static_cast<word>(static_cast<long long>(f) - min[I]) & mask<I>) << offset[I]) | ...));
+	}
+
+	template <size_t... I>
+	static constexpr std::tuple<Fields...> unpack(word w, std::index_sequence<I...>) noexcept
+	{
+		return {get<I>(w)...};
+	}
+};
+
+using Record = packed_record<Mode, Test, Speed>;
+
+// Check it at compile time.
+static_assert(Record::bits == 17);
+static_assert(sizeof(Record::word) == 4);
+static_assert(Record::get<2>(Record::pack(Check, Test::HighSpeed, Speed::Flight)) == Speed::Flight);
+static_assert(Record::get<0>(Record::pack(Check, Test::HighSpeed, Speed::Flight)) == Check);
+static_assert(Record::unpack(Record::pack(Flight, Test::Deploy, Speed{2399})) ==
+	std::tuple{Flight, Test::Deploy, Speed{2399}});
+
+// A field can take all 64 bits.
+enum class Timestamp : uint64_t {};
+
+template <>
+struct field_range<Timestamp> {
+	static constexpr Timestamp min{};
+	static constexpr Timestamp max{~uint64_t{0}};
+};
+
+static_assert(packed_record<Timestamp>::width[0] == 64);
+static_assert(packed_record<Timestamp>::get<0>(packed_record<Timestamp>::pack(Timestamp{~uint64_t{0} - 1U})) ==
+	Timestamp{~uint64_t{0} - 1U});
+
+int main(int argc, char** argv)
+{
+	// A flight of n samples.
+	size_t n = bench::scale(argc, argv, 1'000'000);
+	std::vector<Sample> samples(n);
+	uint32_t x = 1;
+	for(auto& s : samples) {
+		x = x * 1664525U + 1013904223U;
+		s.mode = static_cast<Mode>((x >> 16U) % 5U);
+		s.test = static_cast<Test>(x >> 30U);
+		s.speed = static_cast<Speed>((x >> 8U) % 2538U);
+	}
+
+	std::cout << "sizeof(Sample) = " << sizeof(Sample) << ", packed bits = " << Record::bits
+		<< ", sizeof(Record::word) = " << sizeof(Record::word) << std::endl;
+
+	// At 1 kHz, this is the log bandwidth.
+	for(auto size : {sizeof(Sample), sizeof(Record::word)})
+		std::cout << "  " << size << " bytes per sample: " << static_cast<double>(size) * 1000.0 / 1024.0
+			<< " kB/s, " << static_cast<double>(size) * 1000.0 * 3600.0 / 1024.0 / 1024.0 << " MB/hour" << std::endl;
+
+	std::cout << std::endl << n << " samples:" << std::endl;
+
+	std::vector<Record::word> log(n);
+	bench::measure("pack", n, [&] {
+		for(size_t i = 0; i < n; i++)
+			log[i] = Record::pack(samples[i].mode, samples[i].test, samples[i].speed);
+		bench::escape(log);
+	});
+
+	Sample* wrong = nullptr;
+	bench::measure("unpack all fields", n, [&] {
+		for(size_t i = 0; i < n; i++) {
+			auto [mode, test, speed] = Record::unpack(log[i]);
+			auto const& s = samples[i];
+			if(mode != s.mode || test != s.test || speed != s.speed)
+				wrong = &samples[i];
+		}
+	});
+
+	if(wrong)
+		return 1;
+
+	// Usually, you only need one field, say the speed, of all samples.
+	std::vector<Speed> speed(n);
+	bench::measure("speed column, from Sample[]", n, [&] {
+		for(size_t i = 0; i < n; i++)
+			speed[i] = samples[i].speed;
+		bench::escape(speed);
+	});
+
+	bench::measure("speed column, decode", n, [&] {
+		Record::decode<2>(log.data(), speed.data(), n);
+		bench::escape(speed);
+	});
+
+	// The decoding is a few instructions, but the log is three times
+	// smaller. When the data comes from memory, disk or a radio link,
+	// fewer bytes usually wins.
+}
+
+/*
+ * Further reading:
+ *
+ * https://en.cppreference.com/w/cpp/language/bit_field
+ * https://en.cppreference.com/w/cpp/numeric/bit_width
+ *
+ * See also 20210419_enums and 20211004_layout.
+ */
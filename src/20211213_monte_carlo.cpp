@@ -0,0 +1,348 @@
+﻿/*
+ * Monte Carlo
+ *
+ * 20210426_sfinae prints the chance of dying within a year, by a handful of
+ * causes, for a few kinds of people. Which causes apply to whom is decided by
+ * the compiler: a ThrillSeeker has a motor_cycling type, so the motorcycle
+ * accident overload applies; a FearfulPerson is vaccinated, so COVID-19
+ * returns infinity. Nice, but "1 in 8303" is hard to imagine. What does it
+ * mean for a city of a million people?
+ *
+ * Just try it: give every person a random number every year, and see who
+ * dies of what. That is a Monte Carlo simulation. It is slow, as you need
+ * many samples to see rare events, but every sample is independent, so it
+ * can be spread over all cores, and the inner loop over all vector lanes.
+ *
+ * Scroll down to main() and follow the program flow.
+ */
+
+// These includes are just for this example.
+#include "bench.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// The types and risk functions of 20210426_sfinae. The functions are
+// constexpr here, so we can compute with them at compile time.
+struct Person {
+	using can_walk = int;
+	enum { vaccinated = 0 };
+};
+
+struct USCitizen : public Person {
+	using living_in_us = int;
+};
+
+template <typename P = Person>
+struct FearfulPerson : public P {
+	using afraid_of_water = int;
+	enum { vaccinated = 1 };
+};
+
+template <typename P = Person>
+struct ThrillSeeker : public P {
+	using flying = int;
+	using motor_cycling = int;
+	bool living_near_water;
+};
+
+constexpr double motorcycle_accident(Person const& person)
+{
+	return std::numeric_limits<double>::infinity();
+}
+
+template <typename P, typename P::motor_cycling = 0>
+constexpr int motorcycle_accident(P&& person)
+{
+	return 70072;
+}
+
+template <typename P>
+constexpr typename P::can_walk traffic_accident_as_pedestrian(P&& person)
+{
+	return 42600;
+}
+
+template <typename P>
+constexpr int firearm(P&& person, typename P::living_in_us = 0)
+{
+	return 23439;
+}
+
+template <typename P>
+constexpr int flood(P&& person, bool P::* = &P::living_near_water)
+{
+	return 7435624;
+}
+
+template <typename P, typename std::enable_if<!P::vaccinated, int>::type = 0>
+constexpr int die_from_covid19(P&& person)
+{
+	return 1016;
+}
+
+template <typename P, typename std::enable_if<P::vaccinated, int>::type = 0>
+constexpr double die_from_covid19(P&& person)
+{
+	return std::numeric_limits<double>::infinity();
+}
+
+constexpr int hit_by_lightning() { return 14224671; }
+
+
+
+// An overload set cannot be passed around, but an object with a templated
+// operator() can. The trailing return type makes the operator() only exist
+// when the risk function can be called for a P; SFINAE again. Note that the
+// risk functions take P&&, and only work for an rvalue P: for an lvalue, P is
+// deduced as a reference, which has no members. Hence the std::forward.
+struct Covid19 {
+	static constexpr std::string_view name = "COVID-19";
+	template <typename P>
+	constexpr auto operator()(P&& p) const -> decltype(die_from_covid19(std::forward<P>(p))) { return die_from_covid19(std::forward<P>(p)); }
+};
+
+struct Firearm {
+	static constexpr std::string_view name = "firearm";
+	template <typename P>
+	constexpr auto operator()(P&& p) const -> decltype(firearm(std::forward<P>(p))) { return firearm(std::forward<P>(p)); }
+};
+
+struct Pedestrian {
+	static constexpr std::string_view name = "pedestrian";
+	template <typename P>
+	constexpr auto operator()(P&& p) const -> decltype(traffic_accident_as_pedestrian(std::forward<P>(p))) { return traffic_accident_as_pedestrian(std::forward<P>(p)); }
+};
+
+struct Motorcycle {
+	static constexpr std::string_view name = "motorcycle";
+	template <typename P>
+	constexpr auto operator()(P&& p) const -> decltype(motorcycle_accident(std::forward<P>(p))) { return motorcycle_accident(std::forward<P>(p)); }
+};
+
+struct Flood {
+	static constexpr std::string_view name = "flood";
+	template <typename P>
+	constexpr auto operator()(P&& p) const -> decltype(flood(std::forward<P>(p))) { return flood(std::forward<P>(p)); }
+};
+
+struct Lightning {
+	static constexpr std::string_view name = "lightning";
+	template <typename P>
+	constexpr auto operator()(P&& /*p*/) const { return hit_by_lightning(); }
+};
+
+template <typename... Cause>
+struct causes {
+	static constexpr size_t count = sizeof...(Cause);
+	static constexpr std::array<std::string_view, count> names{Cause::name...};
+
+	// The annual probability of every cause for a P. A cause that does
+	// not apply, or that returns infinity, has probability 0.
+	template <typename P>
+	static constexpr std::array<double, count> risks()
+	{
+		return {risk<P, Cause>()...};
+	}
+
+private:
+	template <typename P, typename C>
+	static constexpr double risk()
+	{
+		if constexpr(std::is_invocable_v<C, P>) {
+			double one_in = static_cast<double>(C{}(P{}));
+			return one_in == std::numeric_limits<double>::infinity() ? 0.0 : 1.0 / one_in;
+		} else {
+			return 0.0;
+		}
+	}
+};
+
+using Causes = causes<Covid19, Firearm, Pedestrian, Motorcycle, Flood, Lightning>;
+
+// These are all computed by the compiler.
+static_assert(Causes::risks<FearfulPerson<>>()[0] == 0.0);
+static_assert(Causes::risks<Person>()[0] == 1.0 / 1016.0);
+static_assert(Causes::risks<Person>()[1] == 0.0);
+static_assert(Causes::risks<ThrillSeeker<USCitizen>>()[1] == 1.0 / 23439.0);
+
+// A population: how many person-years of every kind of person, and the risks
+// that apply to them.
+struct Group {
+	std::string_view name;
+	std::array<double, Causes::count> risk;
+	uint64_t years;
+};
+
+template <typename P>
+static Group group(std::string_view name, uint64_t years)
+{
+	static constexpr auto risk = Causes::risks<P>();
+	return {name, risk, years};
+}
+
+// The random number generator. splitmix64 computes the i-th random number of
+// a stream directly from i, so there is no state that carries from one
+// iteration to the next. Every group has its own stream, every thread takes
+// its own part of it, and within a thread, the compiler can compute several
+// numbers at the same time.
+static constexpr uint64_t splitmix64(uint64_t x) noexcept
+{
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30U)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27U)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31U);
+}
+
+using Counts = std::array<uint64_t, Causes::count>;
+
+// Simulate person-years [begin, end) of a group. Every person-year gets one
+// random number u in [0, 2^64). The causes are stacked on top of each other:
+// the person dies of cause i when u falls in the i-th slice. Counting how
+// often u is below the top of every slice is branch-free; the deaths per cause
+// are the differences between these counts.
+static Counts simulate(Group const& g, uint64_t stream, uint64_t begin, uint64_t end)
+{
+	std::array<uint64_t, Causes::count> threshold{};
+	double top = 0;
+	for(size_t c = 0; c < Causes::count; c++) {
+		top += g.risk[c];
+		threshold[c] = static_cast<uint64_t>(std::ldexp(static_cast<long double>(top), 64));
+	}
+
+	Counts below{};
+	uint64_t const seed = splitmix64(stream) * 0x2545f4914f6cdd1dULL;
+	for(uint64_t i = begin; i < end; i++) {
+		uint64_t u = splitmix64(seed + i);
+		for(size_t c = 0; c < Causes::count; c++)
+			below[c] += u < threshold[c] ? 1U : 0U;
+	}
+
+	Counts deaths{};
+	for(size_t c = Causes::count; c > 0; c--)
+		deaths[c - 1U] = below[c - 1U] - (c > 1U ? below[c - 2U] : 0U);
+	return deaths;
+}
+
+// Split all person-years over the threads. Thread t simulates the t-th part
+// of every group.
+static std::vector<Counts> simulate(std::vector<Group> const& population, unsigned threads)
+{
+	std::vector<std::vector<Counts>> partial(threads, std::vector<Counts>(population.size()));
+	std::vector<std::thread> workers;
+
+	for(unsigned t = 0; t < threads; t++)
+		workers.emplace_back([&, t] {
+			for(size_t g = 0; g < population.size(); g++) {
+				auto years = population[g].years;
+				auto begin = years * t / threads;
+				auto end = years * (t + 1U) / threads;
+				partial[t][g] = simulate(population[g], g, begin, end);
+			}
+		});
+
+	for(auto& w : workers)
+		w.join();
+
+	std::vector<Counts> total(population.size());
+	for(auto const& p : partial)
+		for(size_t g = 0; g < population.size(); g++)
+			for(size_t c = 0; c < Causes::count; c++)
+				total[g][c] += p[g][c];
+
+	return total;
+}
+
+// Print k deaths out of n as "1 in x", with a 95% confidence interval (Wilson
+// score interval, which behaves for small k).
+static void print_rate(uint64_t k, uint64_t n)
+{
+	double const z = 1.96;
+	double nn = static_cast<double>(n);
+	double p = static_cast<double>(k) / nn;
+	double denom = 1.0 + z * z / nn;
+	double center = (p + z * z / (2.0 * nn)) / denom;
+	double half = z * std::sqrt(p * (1.0 - p) / nn + z * z / (4.0 * nn * nn)) / denom;
+
+	std::cout << std::setw(10) << k << "  1 in ";
+	if(k == 0)
+		std::cout << std::setw(10) << "-";
+	else
+		std::cout << std::setw(10) << std::lround(1.0 / p);
+	std::cout << "  [" << std::lround(1.0 / (center + half)) << ", ";
+	if(center - half > 0)
+		std::cout << std::lround(1.0 / (center - half));
+	else
+		std::cout << "inf";
+	std::cout << "]" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	// A city, simulated for a number of person-years. Try 100000000.
+	uint64_t n = bench::scale(argc, argv, 1'000'000);
+
+	std::vector<Group> population{
+		group<Person>("Person", n / 2U),
+		group<USCitizen>("USCitizen", n / 4U),
+		group<ThrillSeeker<USCitizen>>("ThrillSeeker<USCitizen>", n / 8U),
+		group<FearfulPerson<>>("FearfulPerson", n / 16U),
+		group<ThrillSeeker<FearfulPerson<>>>("ThrillSeeker<FearfulPerson>", n / 16U),
+	};
+
+	uint64_t total_years = 0;
+	for(auto const& g : population)
+		total_years += g.years;
+
+	unsigned threads = std::max(1U, std::thread::hardware_concurrency());
+	std::vector<Counts> deaths;
+
+	std::cout << total_years << " person-years, " << threads << " threads:" << std::endl;
+	bench::measure("simulate", total_years, [&] {
+		deaths = simulate(population, threads);
+	});
+
+	// The results. With enough person-years, the intervals contain the
+	// numbers of 20210426_sfinae.
+	for(size_t g = 0; g < population.size(); g++) {
+		std::cout << std::endl << population[g].name << ":" << std::endl;
+		for(size_t c = 0; c < Causes::count; c++) {
+			if(population[g].risk[c] == 0.0)
+				continue;
+			std::cout << "  " << std::left << std::setw(12) << Causes::names[c] << std::right;
+			print_rate(deaths[g][c], population[g].years);
+		}
+	}
+
+	// The same simulation with one thread gives exactly the same counts,
+	// as the random numbers only depend on the index of the person-year.
+	if(threads > 1U && simulate(population, 1) != deaths)
+		return 1;
+
+	// The simulation does as many comparisons per person-year as there
+	// are causes, for every person. When probabilities are this small,
+	// you could also draw how many years until the next death directly
+	// (a geometric distribution), and skip all survivors. Monte Carlo is
+	// simple, but clever math is faster.
+}
+
+/*
+ * Further reading:
+ *
+ * https://en.wikipedia.org/wiki/Monte_Carlo_method
+ * https://en.wikipedia.org/wiki/Binomial_proportion_confidence_interval
+ * https://prng.di.unimi.it/splitmix64.c
+ *
+ * See also 20210426_sfinae and 20210208_atomic.
+ */
@@ -0,0 +1,300 @@
+﻿/*
+ * Detection idiom
+ *
+ * In 20210426_sfinae, every line in main() calls a risk function for a type
+ * of person, and the compiler picks the right overload, or refuses to compile.
+ * That is great if you know the type at compile time. But say the user picks
+ * a type from a list at run time, and asks for all risks. You cannot call a
+ * function that does not exist for that type, and you need some table with
+ * all combinations anyway.
+ *
+ * So, let the compiler fill that table. For every type and every risk
+ * function, ask "can I call this?", and if so, call it. Asking whether an
+ * expression is valid, without getting an error when it is not, is called the
+ * detection idiom. It is SFINAE, packaged in a reusable way.
+ *
+ * Scroll down to main() and follow the program flow.
+ */
+
+// These includes are just for this example.
+#include <array>
+#include <cstddef>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+// The types and risk functions of 20210426_sfinae. The functions are
+// constexpr here, such that the compiler can call them to fill the table.
+struct Person {
+	using can_walk = int;
+	enum { vaccinated = 0 };
+};
+
+struct USCitizen : public Person {
+	using living_in_us = int;
+};
+
+template <typename P = Person>
+struct FearfulPerson : public P {
+	using afraid_of_water = int;
+	enum { vaccinated = 1 };
+};
+
+template <typename P = Person>
+struct ThrillSeeker : public P {
+	using flying = int;
+	using motor_cycling = int;
+	bool living_near_water;
+};
+
+constexpr double motorcycle_accident(Person const& person)
+{
+	return std::numeric_limits<double>::infinity();
+}
+
+template <typename P, typename P::motor_cycling = 0>
+constexpr int motorcycle_accident(P&& person)
+{
+	return 70072;
+}
+
+template <typename P>
+constexpr typename P::can_walk traffic_accident_as_pedestrian(P&& person)
+{
+	return 42600;
+}
+
+template <typename P>
+constexpr int firearm(P&& person, typename P::living_in_us = 0)
+{
+	return 23439;
+}
+
+template <typename P>
+constexpr int flood(P&& person, bool P::* = &P::living_near_water)
+{
+	return 7435624;
+}
+
+template <typename P, std::enable_if_t<std::is_same_v<P, Person>, int> = 0>
+constexpr int fall_from_ladder(P&& person)
+{
+	return 674572;
+}
+
+template <typename P, typename std::enable_if<!P::vaccinated, int>::type = 0>
+constexpr int die_from_covid19(P&& person)
+{
+	return 1016;
+}
+
+template <typename P, typename std::enable_if<P::vaccinated, int>::type = 0>
+constexpr double die_from_covid19(P&& person)
+{
+	return std::numeric_limits<double>::infinity();
+}
+
+template <typename P, typename std::enable_if<std::is_trivial<P>::value, int>::type = 0>
+constexpr int die_from_astrazeneca(P&& person)
+{
+	return 656250;
+}
+
+template <typename P, std::enable_if_t<std::is_same_v<typename P::living_in_us, int>, int> = 0>
+constexpr int die_from_johnsonjohnson(P&& person)
+{
+	return 3400000;
+}
+
+constexpr int hit_by_lightning() { return 14224671; }
+constexpr int driving() { return 8303; }
+constexpr int cataclismic_storm() { return 4304835; }
+
+
+
+// The detection idiom. is_detected_v<Op, Args...> is true when Op<Args...> is
+// a valid type, and false otherwise. The primary template handles the false
+// case. The specialization is only valid when Op<Args...> is, in which case
+// std::void_t<...> is void, and it matches better. This is what
+// std::experimental::is_detected does, but that is not in the standard (yet).
+template <typename, template <typename...> class Op, typename... Args>
+struct detector : std::false_type {};
+
+template <template <typename...> class Op, typename... Args>
+struct detector<std::void_t<Op<Args...>>, Op, Args...> : std::true_type {};
+
+template <template <typename...> class Op, typename... Args>
+inline constexpr bool is_detected_v = detector<void, Op, Args...>::value;
+
+// For every risk function, the expression to detect. std::declval<P>() is an
+// rvalue P, just like the P{} in 20210426_sfinae.
+template <typename P> using covid19_t     = decltype(die_from_covid19(std::declval<P>()));
+template <typename P> using firearm_t     = decltype(firearm(std::declval<P>()));
+template <typename P> using pedestrian_t  = decltype(traffic_accident_as_pedestrian(std::declval<P>()));
+template <typename P> using motorcycle_t  = decltype(motorcycle_accident(std::declval<P>()));
+template <typename P> using flood_t       = decltype(flood(std::declval<P>()));
+template <typename P> using ladder_t      = decltype(fall_from_ladder(std::declval<P>()));
+template <typename P> using astrazeneca_t = decltype(die_from_astrazeneca(std::declval<P>()));
+template <typename P> using jnj_t         = decltype(die_from_johnsonjohnson(std::declval<P>()));
+
+// Every cause: its name, and the "1 in ..." for a P. A cause that does not
+// apply to P never happens: infinity.
+constexpr double never = std::numeric_limits<double>::infinity();
+
+// Call f() if Op<P> is valid, or return never.
+template <template <typename...> class Op, typename P, typename F>
+constexpr double if_detected(F f)
+{
+	if constexpr(is_detected_v<Op, P>)
+		return static_cast<double>(f(P{}));
+	else
+		return never;
+}
+
+enum Cause : size_t {
+	Covid19,
+	Firearm,
+	Pedestrian,
+	Motorcycle,
+	Flood,
+	Ladder,
+	AstraZeneca,
+	JohnsonJohnson,
+	Lightning,
+	Driving,
+	Storm,
+	Causes,
+};
+
+constexpr std::array<std::string_view, Causes> cause_names{
+	"COVID-19", "firearm", "pedestrian", "motorcycle", "flood", "ladder",
+	"AstraZeneca", "J&J", "lightning", "driving", "storm"};
+
+template <typename P>
+constexpr std::array<double, Causes> risks()
+{
+	// The generic lambdas are only instantiated when the Op is detected, so
+	// the invalid calls are never compiled.
+	return {
+		if_detected<covid19_t, P>([](auto p) { return die_from_covid19(std::move(p)); }),
+		if_detected<firearm_t, P>([](auto p) { return firearm(std::move(p)); }),
+		if_detected<pedestrian_t, P>([](auto p) { return traffic_accident_as_pedestrian(std::move(p)); }),
+		if_detected<motorcycle_t, P>([](auto p) { return motorcycle_accident(std::move(p)); }),
+		if_detected<flood_t, P>([](auto p) { return flood(std::move(p)); }),
+		if_detected<ladder_t, P>([](auto p) { return fall_from_ladder(std::move(p)); }),
+		if_detected<astrazeneca_t, P>([](auto p) { return die_from_astrazeneca(std::move(p)); }),
+		if_detected<jnj_t, P>([](auto p) { return die_from_johnsonjohnson(std::move(p)); }),
+		static_cast<double>(hit_by_lightning()),
+		static_cast<double>(driving()),
+		static_cast<double>(cataclismic_storm()),
+	};
+}
+
+// The table: a row per type, a column per cause. It is a plain array of
+// doubles; no templates are needed to use it.
+template <typename... P>
+struct risk_table {
+	static constexpr size_t types = sizeof...(P);
+	static constexpr std::array<std::array<double, Causes>, types> table{risks<P>()...};
+
+	// The row of a type.
+	template <typename T>
+	static constexpr size_t index_of()
+	{
+		constexpr std::array<bool, types> match{std::is_same_v<T, P>...};
+		for(size_t i = 0; i < types; i++)
+			if(match[i])
+				return i;
+		return types;
+	}
+
+	static constexpr double one_in(size_t type, Cause cause) noexcept
+	{
+		return table[type][cause];
+	}
+};
+
+// All types we know of. Add a type here, and its row is generated. An
+// Astronaut is careful (vaccinated), but also a thrill seeker, from the US.
+using Astronaut = ThrillSeeker<FearfulPerson<USCitizen>>;
+
+using Risks = risk_table<
+	Person,
+	USCitizen,
+	FearfulPerson<>,
+	ThrillSeeker<>,
+	ThrillSeeker<USCitizen>,
+	ThrillSeeker<FearfulPerson<>>,
+	Astronaut>;
+
+static constexpr std::array<std::string_view, Risks::types> type_names{
+	"Person", "USCitizen", "FearfulPerson<>", "ThrillSeeker<>",
+	"ThrillSeeker<USCitizen>", "ThrillSeeker<FearfulPerson<>>", "Astronaut"};
+
+// The compile-time test. If a risk function or a type changes, this tells.
+// These are the numbers that main() of 20210426_sfinae prints.
+static_assert(Risks::one_in(Risks::index_of<ThrillSeeker<>>(), Covid19) == 1016);
+static_assert(Risks::one_in(Risks::index_of<ThrillSeeker<USCitizen>>(), Firearm) == 23439);
+static_assert(Risks::one_in(Risks::index_of<USCitizen>(), Pedestrian) == 42600);
+static_assert(Risks::one_in(Risks::index_of<ThrillSeeker<>>(), Motorcycle) == 70072);
+static_assert(Risks::one_in(Risks::index_of<Person>(), AstraZeneca) == 656250);
+static_assert(Risks::one_in(Risks::index_of<Person>(), Ladder) == 674572);
+static_assert(Risks::one_in(Risks::index_of<USCitizen>(), JohnsonJohnson) == 3400000);
+static_assert(Risks::one_in(Risks::index_of<ThrillSeeker<>>(), Flood) == 7435624);
+static_assert(Risks::one_in(Risks::index_of<FearfulPerson<>>(), Motorcycle) == never);
+static_assert(Risks::one_in(Risks::index_of<FearfulPerson<>>(), Covid19) == never);
+
+// And the rows of the new type are what we expect: the risks of both its
+// bases, but vaccinated.
+static_assert(Risks::one_in(Risks::index_of<Astronaut>(), Covid19) == never);
+static_assert(Risks::one_in(Risks::index_of<Astronaut>(), Firearm) == 23439);
+static_assert(Risks::one_in(Risks::index_of<Astronaut>(), Motorcycle) == 70072);
+static_assert(Risks::one_in(Risks::index_of<Astronaut>(), Ladder) == never);
+
+// Every type has a row, and a name.
+static_assert(Risks::table.size() == type_names.size());
+static_assert(Risks::index_of<int>() == Risks::types);
+
+int main(int argc, char** argv)
+{
+	// Pick a type at run time, by index. The first argument selects one;
+	// by default, print all.
+	size_t first = 0;
+	size_t last = Risks::types;
+	if(argc > 1) {
+		first = static_cast<size_t>(std::strtoul(argv[1], nullptr, 0));
+		if(first >= Risks::types)
+			return 1;
+		last = first + 1U;
+	}
+
+	std::cout << "Chance of dying within one year, 1 in ..." << std::endl;
+
+	for(size_t t = first; t < last; t++) {
+		std::cout << std::endl << type_names[t] << ":" << std::endl;
+		for(size_t c = 0; c < Causes; c++) {
+			double one_in = Risks::one_in(t, static_cast<Cause>(c));
+			if(one_in == never)
+				continue;
+
+			std::cout << "  " << std::left << std::setw(12) << cause_names[c] << std::right
+				<< std::setw(10) << static_cast<long>(one_in) << std::endl;
+		}
+	}
+
+	// Looking up a risk is an index into an array of doubles. All
+	// overload resolution, SFINAE and detection happened while compiling.
+}
+
+/*
+ * Further reading:
+ *
+ * https://en.cppreference.com/w/cpp/experimental/is_detected
+ * https://en.cppreference.com/w/cpp/types/void_t
+ *
+ * See also 20210426_sfinae and 20211213_monte_carlo.
+ */
@@ -0,0 +1,694 @@
+﻿/*
+ * Serialization
+ *
+ * 20210503_bind shows that structured binding works on arrays, tuples,
+ * aggregates like Module, and any class that implements the tuple protocol,
+ * like ISS. That is a form of reflection: for all these types, you can get to
+ * every field, in order, without knowing the type up front. Which is exactly
+ * what you need to write something to a file, or send it over a network.
+ *
+ * Let's write a serializer that works for all of these, without writing a
+ * single line of code per type. The format is binary and little-endian, such
+ * that it can be read on another machine. Types that are just bytes, like
+ * an array of ints, are copied in one go, and so are runs of such fields in
+ * a struct. And when reading, strings are not copied: they point into the
+ * buffer you read from.
+ *
+ * Scroll down to main() and follow the program flow.
+ */
+
+// These includes are just for this example.
+#include "bench.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// The types of 20210503_bind.
+struct Module {
+	int launch;
+	char const* by = "rocket";
+};
+
+struct Tiange : Module {};
+struct Wentian : Module {};
+struct Mengtian : Module {};
+
+using Tiangong = std::tuple<Tiange, Wentian, Mengtian>;
+
+class ISS {
+protected:
+	using Connection = std::pair<Module&,Module&>;
+
+	Module zarya{1998, "Proton-K"};
+	Module unity{1998, "Endeavour"};
+	Connection c1{zarya, unity};
+	Module destiny{2001, "Atlantis"};
+	Connection c2{unity, destiny};
+	Module harmony{2007, "Discovery"};
+	Connection c3{destiny, harmony};
+	Module tranquility{2010, "Endeavour"};
+	Connection c4{unity, tranquility};
+	Module beam{2016, "Falcon-9"};
+	Connection c5{tranquility, beam};
+
+public:
+	template <size_t i>
+	std::enable_if_t<i < 6U, Module const&> get() const noexcept {
+		switch(i) {
+		case 0: return zarya;
+		case 1: return unity;
+		case 2: return destiny;
+		case 3: return harmony;
+		case 4: return tranquility;
+		case 5: return beam;
+		default: std::terminate();
+		}
+	}
+};
+
+template <>
+struct std::tuple_size<ISS> { enum { value = 6 }; };
+
+template <size_t i>
+struct std::tuple_element<i, ISS> { using type = Module; };
+
+
+
+////////////////////////////////////////////
+// Counting the fields of an aggregate
+//
+
+// An aggregate with N fields can be brace-initialized with up to N values. A
+// value that converts to anything tells us how many we can pass.
+template <size_t>
+struct any_field {
+	template <typename U>
+	operator U() const; // Only declared; it is only used in decltype.
+};
+
+template <typename T, typename Seq, typename = void>
+struct brace_constructible : std::false_type {};
+
+template <typename T, size_t... I>
+struct brace_constructible<T, std::index_sequence<I...>, std::void_t<decltype(T{any_field<I>{}...})>>
+	: std::true_type {};
+
+template <typename T, size_t N = 8>
+constexpr size_t arity()
+{
+	if constexpr(N == 0)
+		return 0;
+	else if constexpr(brace_constructible<T, std::make_index_sequence<N>>::value)
+		return N;
+	else
+		return arity<T, N - 1U>();
+}
+
+static_assert(arity<Module>() == 2);
+
+// C++ has no way to find the base class of a type. Tiange has no members of
+// its own, only the ones of Module, which can be initialized by a single
+// Module. Then brace counting gives 1, while structured binding needs 2. Tell
+// the serializer to use the base instead.
+template <typename T>
+struct aggregate_base { using type = void; };
+
+template <> struct aggregate_base<Tiange>   { using type = Module; };
+template <> struct aggregate_base<Wentian>  { using type = Module; };
+template <> struct aggregate_base<Mengtian> { using type = Module; };
+
+// Turn an aggregate into a tuple of references to its fields. Structured
+// binding needs the number of names to be written out, so there is one case
+// per count.
+template <typename T>
+constexpr auto fields(T& t)
+{
+	constexpr size_t n = arity<std::remove_const_t<T>>();
+	if constexpr(n == 0) {
+		return std::tie();
+	} else if constexpr(n == 1) {
+		auto& [a] = t;
+		return std::tie(a);
+	} else if constexpr(n == 2) {
+		auto& [a, b] = t;
+		return std::tie(a, b);
+	} else if constexpr(n == 3) {
+		auto& [a, b, c] = t;
+		return std::tie(a, b, c);
+	} else if constexpr(n == 4) {
+		auto& [a, b, c, d] = t;
+		return std::tie(a, b, c, d);
+	} else if constexpr(n == 5) {
+		auto& [a, b, c, d, e] = t;
+		return std::tie(a, b, c, d, e);
+	} else if constexpr(n == 6) {
+		auto& [a, b, c, d, e, f] = t;
+		return std::tie(a, b, c, d, e, f);
+	} else if constexpr(n == 7) {
+		auto& [a, b, c, d, e, f, g] = t;
+		return std::tie(a, b, c, d, e, f, g);
+	} else {
+		static_assert(n == 8, "Too many fields");
+		auto& [a, b, c, d, e, f, g, h] = t;
+		return std::tie(a, b, c, d, e, f, g, h);
+	}
+}
+
+// The tuple protocol: std::tuple_size is defined, and get<i> is either a
+// member (like ISS), or a free function (like std::get).
+template <typename T, typename = void>
+struct is_tuple_like : std::false_type {};
+
+template <typename T>
+struct is_tuple_like<T, std::void_t<decltype(std::tuple_size<T>::value)>> : std::true_type {};
+
+template <typename T, typename = void>
+struct has_member_get : std::false_type {};
+
+template <typename T>
+struct has_member_get<T, std::void_t<decltype(std::declval<T&>().template get<0>())>> : std::true_type {};
+
+template <size_t I, typename T>
+constexpr decltype(auto) tuple_get(T& t)
+{
+	if constexpr(has_member_get<T>::value) {
+		return t.template get<I>();
+	} else {
+		using std::get;
+		return get<I>(t);
+	}
+}
+
+template <typename T>
+struct is_vector : std::false_type {};
+
+template <typename T>
+struct is_vector<std::vector<T>> : std::true_type {};
+
+// Types that are only bytes, without padding: ints, arrays of ints, structs
+// of ints without holes, and so on. On a little-endian machine, their memory
+// is exactly their serialized form. Note that Module is not: it has a pointer.
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+static constexpr bool little_endian = false;
+#else
+static constexpr bool little_endian = true;
+#endif
+
+template <typename T>
+struct is_std_array : std::false_type {};
+
+template <typename T, size_t N>
+struct is_std_array<std::array<T, N>> : std::true_type {};
+
+template <typename T>
+static constexpr bool is_plain_bytes();
+
+template <typename Fields>
+struct all_plain_bytes;
+
+template <typename... F>
+struct all_plain_bytes<std::tuple<F&...>> : std::bool_constant<(is_plain_bytes<F>() && ...)> {};
+
+template <typename T>
+static constexpr bool is_plain_bytes()
+{
+	if constexpr(!little_endian || !std::has_unique_object_representations_v<T> || std::is_pointer_v<T>)
+		return false;
+	else if constexpr(std::is_integral_v<T> || std::is_enum_v<T>)
+		return true;
+	else if constexpr(std::is_array_v<T>)
+		return is_plain_bytes<std::remove_extent_t<T>>();
+	else if constexpr(is_std_array<T>::value)
+		return is_plain_bytes<typename T::value_type>();
+	else if constexpr(is_tuple_like<T>::value)
+		// A std::tuple may store its elements in any order.
+		return false;
+	else if constexpr(std::is_aggregate_v<T> && std::is_void_v<typename aggregate_base<T>::type>)
+		return all_plain_bytes<decltype(fields(std::declval<T&>()))>::value;
+	else
+		return false;
+}
+
+static_assert(is_plain_bytes<int[2]>());
+static_assert(is_plain_bytes<std::array<int, 2>>());
+static_assert(!is_plain_bytes<Module>());
+
+// A struct that is not plain bytes as a whole may still have plain fields in
+// a row, like year, month and day here. When there is no padding between
+// them, they are copied in one go too.
+struct Launch {
+	int16_t year;
+	uint8_t month;
+	uint8_t day;
+	char const* rocket;
+};
+
+static_assert(!is_plain_bytes<Launch>());
+
+// The end of the run of plain fields that starts at field I.
+template <size_t I, typename... F>
+constexpr size_t plain_run_end() noexcept
+{
+	constexpr std::array<bool, sizeof...(F)> plain{is_plain_bytes<std::remove_const_t<F>>()...};
+	size_t end = I;
+	while(end < plain.size() && plain[end])
+		end++;
+	return end;
+}
+
+// The size of fields Begin to End, or 0 if there is padding between them. The
+// offsets are fixed, so the compiler computes this at compile time.
+template <size_t Begin, size_t End, typename... F>
+static size_t run_size(std::tuple<F&...> const& f) noexcept
+{
+	constexpr std::array<size_t, sizeof...(F)> sizes{sizeof(F)...};
+	size_t fields_size = 0;
+	for(size_t i = Begin; i < End; i++)
+		fields_size += sizes[i];
+
+	auto first = reinterpret_cast<uintptr_t>(std::addressof(std::get<Begin>(f)));
+	auto last = reinterpret_cast<uintptr_t>(std::addressof(std::get<End - 1U>(f)));
+	return last + sizes[End - 1U] - first == fields_size ? fields_size : 0;
+}
+
+// Strings are written as a 32-bit length, the characters, and a terminating
+// zero. A null char const* has this length, and nothing else.
+static constexpr uint32_t null_string = ~uint32_t{0};
+
+// The minimum number of bytes a value takes when it is serialized. A reader
+// uses it to check the length of a vector before allocating it.
+template <typename T>
+static constexpr size_t min_size();
+
+template <typename Fields>
+struct fields_min_size;
+
+template <typename... F>
+struct fields_min_size<std::tuple<F&...>> : std::integral_constant<size_t, (min_size<F>() + ... + 0U)> {};
+
+template <typename T, size_t... I>
+static constexpr size_t tuple_min_size(std::index_sequence<I...>)
+{
+	return (min_size<std::tuple_element_t<I, T>>() + ... + 0U);
+}
+
+template <typename T>
+static constexpr size_t min_size()
+{
+	if constexpr(is_plain_bytes<T>() || std::is_arithmetic_v<T> || std::is_enum_v<T>)
+		return sizeof(T);
+	else if constexpr(std::is_same_v<T, char const*>)
+		return sizeof(uint32_t);
+	else if constexpr(std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>)
+		return sizeof(uint32_t) + 1U;
+	else if constexpr(is_vector<T>::value)
+		return sizeof(uint64_t);
+	else if constexpr(std::is_array_v<T>)
+		return std::extent_v<T> * min_size<std::remove_extent_t<T>>();
+	else if constexpr(is_tuple_like<T>::value)
+		return tuple_min_size<T>(std::make_index_sequence<std::tuple_size<T>::value>{});
+	else if constexpr(!std::is_void_v<typename aggregate_base<T>::type>)
+		return min_size<typename aggregate_base<T>::type>();
+	else
+		return fields_min_size<decltype(fields(std::declval<T&>()))>::value;
+}
+
+static_assert(min_size<Module>() == 8);
+static_assert(min_size<Launch>() == 8);
+
+
+
+////////////////////////////////////////////
+// Writing
+//
+
+class writer {
+public:
+	template <typename T>
+	void write(T const& x)
+	{
+		if constexpr(is_plain_bytes<T>()) {
+			append(&x, sizeof(x));
+		} else if constexpr(std::is_arithmetic_v<T> || std::is_enum_v<T>) {
+			write_le(x);
+		} else if constexpr(std::is_same_v<T, char const*>) {
+			if(x)
+				write_string(x);
+			else
+				write(null_string);
+		} else if constexpr(std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>) {
+			write_string(x);
+		} else if constexpr(is_vector<T>::value) {
+			write(static_cast<uint64_t>(x.size()));
+			if constexpr(is_plain_bytes<typename T::value_type>())
+				append(x.data(), x.size() * sizeof(typename T::value_type));
+			else
+				for(auto const& e : x)
+					write(e);
+		} else if constexpr(std::is_array_v<T>) {
+			for(auto const& e : x)
+				write(e);
+		} else if constexpr(is_tuple_like<T>::value) {
+			write_tuple(x, std::make_index_sequence<std::tuple_size<T>::value>{});
+		} else if constexpr(!std::is_void_v<typename aggregate_base<T>::type>) {
+			write(static_cast<typename aggregate_base<T>::type const&>(x));
+		} else {
+			static_assert(std::is_aggregate_v<T>, "Cannot serialize this type");
+			write_fields<0>(fields(x));
+		}
+	}
+
+	std::string_view data() const noexcept { return {m_buffer.data(), m_buffer.size()}; }
+	void clear() noexcept { m_buffer.clear(); }
+
+private:
+	void append(void const* p, size_t n)
+	{
+		auto const* c = static_cast<char const*>(p);
+		m_buffer.insert(m_buffer.end(), c, c + n);
+	}
+
+	template <typename T>
+	void write_le(T x)
+	{
+		std::array<char, sizeof(T)> bytes{};
+		std::memcpy(bytes.data(), &x, sizeof(T));
+		if constexpr(!little_endian)
+			std::reverse(bytes.begin(), bytes.end());
+		append(bytes.data(), sizeof(T));
+	}
+
+	// Strings are written with their length, and a terminating zero, such
+	// that a reader can use them in place as a char const*.
+	void write_string(std::string_view s)
+	{
+		if(s.size() >= null_string)
+			throw std::length_error{"String too long"};
+
+		write(static_cast<uint32_t>(s.size()));
+		append(s.data(), s.size());
+		m_buffer.push_back('\0');
+	}
+
+	template <typename T, size_t... I>
+	void write_tuple(T const& t, std::index_sequence<I...>)
+	{
+		(write(tuple_get<I>(t)), ...);
+	}
+
+	template <size_t I, typename... F>
+	void write_fields(std::tuple<F&...> const& f)
+	{
+		if constexpr(I < sizeof...(F)) {
+			constexpr size_t end = plain_run_end<I, F...>();
+			if constexpr(end > I + 1U) {
+				if(size_t size = run_size<I, end>(f)) {
+					append(std::addressof(std::get<I>(f)), size);
+					write_fields<end>(f);
+					return;
+				}
+			}
+
+			write(std::get<I>(f));
+			write_fields<I + 1U>(f);
+		}
+	}
+
+	std::vector<char> m_buffer;
+};
+
+
+
+////////////////////////////////////////////
+// Reading
+//
+
+// A reader does not own the data; it reads from any buffer, for example a
+// file that is mapped into memory. Strings are not copied; a char const* or
+// std::string_view that is read points into the buffer.
+class reader {
+public:
+	explicit reader(std::string_view data) noexcept
+		: m_data{data}
+	{}
+
+	template <typename T>
+	void read(T& x)
+	{
+		if constexpr(is_plain_bytes<T>()) {
+			std::memcpy(&x, take(sizeof(x)), sizeof(x));
+		} else if constexpr(std::is_arithmetic_v<T> || std::is_enum_v<T>) {
+			std::array<char, sizeof(T)> bytes{};
+			std::memcpy(bytes.data(), take(sizeof(T)), sizeof(T));
+			if constexpr(!little_endian)
+				std::reverse(bytes.begin(), bytes.end());
+			std::memcpy(&x, bytes.data(), sizeof(T));
+		} else if constexpr(std::is_same_v<T, char const*>) {
+			x = read_string().data();
+		} else if constexpr(std::is_same_v<T, std::string_view> || std::is_same_v<T, std::string>) {
+			auto s = read_string();
+			if(!s.data())
+				throw std::invalid_argument{"Null string"};
+			x = T{s};
+		} else if constexpr(is_vector<T>::value) {
+			// Corrupt data may have any length. Check that the elements
+			// can be there at all, before allocating them.
+			using E = typename T::value_type;
+			static_assert(min_size<E>() > 0, "Cannot check the length of a vector of empty elements");
+			auto n = read<uint64_t>();
+			if(n > m_data.size() / min_size<E>())
+				throw std::out_of_range{"Truncated data"};
+
+			x.resize(static_cast<size_t>(n));
+			if constexpr(is_plain_bytes<E>())
+				std::memcpy(x.data(), take(x.size() * sizeof(E)), x.size() * sizeof(E));
+			else
+				for(auto& e : x)
+					read(e);
+		} else if constexpr(std::is_array_v<T>) {
+			for(auto& e : x)
+				read(e);
+		} else if constexpr(is_tuple_like<T>::value) {
+			read_tuple(x, std::make_index_sequence<std::tuple_size<T>::value>{});
+		} else if constexpr(!std::is_void_v<typename aggregate_base<T>::type>) {
+			read(static_cast<typename aggregate_base<T>::type&>(x));
+		} else {
+			static_assert(std::is_aggregate_v<T>, "Cannot deserialize this type");
+			read_fields<0>(fields(x));
+		}
+	}
+
+	template <typename T>
+	T read()
+	{
+		T x{};
+		read(x);
+		return x;
+	}
+
+	bool empty() const noexcept { return m_data.empty(); }
+
+private:
+	char const* take(size_t n)
+	{
+		if(n > m_data.size())
+			throw std::out_of_range{"Truncated data"};
+
+		char const* p = m_data.data();
+		m_data.remove_prefix(n);
+		return p;
+	}
+
+	// A null char const* gives a view without data.
+	std::string_view read_string()
+	{
+		auto n = read<uint32_t>();
+		if(n == null_string)
+			return {};
+
+		char const* p = take(static_cast<size_t>(n) + 1U);
+		if(p[n] != '\0')
+			throw std::invalid_argument{"Corrupt string"};
+		return {p, n};
+	}
+
+	template <typename T, size_t... I>
+	void read_tuple(T& t, std::index_sequence<I...>)
+	{
+		(read(tuple_get<I>(t)), ...);
+	}
+
+	template <size_t I, typename... F>
+	void read_fields(std::tuple<F&...> const& f)
+	{
+		if constexpr(I < sizeof...(F)) {
+			constexpr size_t end = plain_run_end<I, F...>();
+			if constexpr(end > I + 1U) {
+				if(size_t size = run_size<I, end>(f)) {
+					std::memcpy(std::addressof(std::get<I>(f)), take(size), size);
+					read_fields<end>(f);
+					return;
+				}
+			}
+
+			read(std::get<I>(f));
+			read_fields<I + 1U>(f);
+		}
+	}
+
+	std::string_view m_data;
+};
+
+int main(int argc, char** argv)
+{
+	// All kinds of types from 20210503_bind, in one go.
+	int tiangong_$[]{2011, 2016};
+	Tiangong tiangong{{{2021, "Long March 5B"}}, {{2022}}, {{2022}}};
+	ISS iss{};
+
+	writer w;
+	w.write(tiangong_$);
+	w.write(tiangong);
+	w.write(iss);
+
+	std::cout << "Serialized into " << w.data().size() << " bytes" << std::endl;
+
+	// Read it back. ISS cannot be constructed from its modules, but it
+	// is written just like six Modules in a row, so read it like that.
+	reader r{w.data()};
+	auto tg = r.read<std::array<int, 2>>();
+	auto t = r.read<Tiangong>();
+	auto modules = r.read<std::array<Module, 6>>();
+
+	std::cout << "tiangong_$: " << tg[0] << ", " << tg[1] << std::endl;
+	std::cout << "Tiange launched in " << std::get<0>(t).launch << " by " << std::get<0>(t).by << std::endl;
+	for(auto const& [launch, by] : modules)
+		std::cout << "ISS module launched in " << launch << " by " << by << std::endl;
+
+	if(!r.empty() || modules[5].launch != 2016 || std::string_view{modules[5].by} != "Falcon-9")
+		return 1;
+
+	// The strings point into the serialized data. No copies.
+	if(modules[0].by < w.data().data() || modules[0].by >= w.data().data() + w.data().size())
+		return 1;
+
+	// The date of a Launch is written in one go; the rocket follows.
+	writer lw;
+	lw.write(Launch{2021, 4, 29, "Long March 5B"});
+	reader lr{lw.data()};
+	auto l = lr.read<Launch>();
+	if(lw.data().size() != 4U + 4U + 14U || l.year != 2021 || l.month != 4 ||
+		l.day != 29 || std::string_view{l.rocket} != "Long March 5B")
+		return 1;
+
+	// A null char const* stays null.
+	writer nw;
+	nw.write(Module{2022, nullptr});
+	if(reader{nw.data()}.read<Module>().by != nullptr)
+		return 1;
+
+	// Data that claims to hold more than it does is rejected before
+	// anything is allocated.
+	writer corrupt;
+	corrupt.write(std::numeric_limits<uint64_t>::max());
+	try {
+		reader{corrupt.data()}.read<std::vector<Module>>();
+		return 1;
+	} catch(std::out_of_range const&) {
+	}
+
+
+
+	// Now, lots of Modules. Try 10000000.
+	size_t n = bench::scale(argc, argv, 100'000);
+	std::vector<Module> log;
+	log.reserve(n);
+	for(size_t i = 0; i < n; i++) {
+		auto const& m = modules[i % modules.size()];
+		log.push_back({m.launch + static_cast<int>(i % 10U), m.by});
+	}
+
+	std::cout << std::endl << n << " Modules:" << std::endl;
+
+	std::ostringstream text;
+	bench::measure("write, iostream", n, [&] {
+		for(auto const& m : log)
+			text << m.launch << ' ' << std::quoted(m.by) << '\n';
+		bench::escape(text);
+	});
+
+	writer binary;
+	bench::measure("write, binary", n, [&] {
+		binary.write(log);
+		bench::escape(binary);
+	});
+
+	std::cout << "  iostream: " << text.str().size() << " bytes, binary: " << binary.data().size() << " bytes" << std::endl;
+
+	// Reading text requires a std::string per Module, to hold the name.
+	std::vector<std::pair<int, std::string>> from_text(n);
+	bench::measure("read, iostream", n, [&] {
+		std::istringstream in{text.str()};
+		for(auto& [launch, by] : from_text)
+			in >> launch >> std::quoted(by);
+		bench::escape(from_text);
+	});
+
+	std::vector<Module> from_binary;
+	bench::measure("read, binary", n, [&] {
+		reader in{binary.data()};
+		in.read(from_binary);
+		bench::escape(from_binary);
+	});
+
+	for(size_t i = 0; i < n; i++)
+		if(from_binary[i].launch != log[i].launch || from_binary[i].by != from_text[i].second ||
+			from_text[i].first != log[i].launch)
+			return 1;
+
+	// A vector of plain ints has no per-element work at all: it is written
+	// and read with a single memcpy.
+	std::vector<int> launches(n);
+	for(size_t i = 0; i < n; i++)
+		launches[i] = log[i].launch;
+
+	writer ints;
+	bench::measure("write, vector<int>", n, [&] {
+		ints.write(launches);
+		bench::escape(ints);
+	});
+
+	bench::measure("read, vector<int>", n, [&] {
+		reader in{ints.data()};
+		bench::escape(in.read<std::vector<int>>());
+	});
+
+	// Keep in mind that the binary format is only as stable as your
+	// types: add a field to Module, and old files cannot be read anymore.
+	// Add a version number to your files.
+}
+
+/*
+ * Further reading:
+ *
+ * https://en.cppreference.com/w/cpp/language/structured_binding
+ * https://en.cppreference.com/w/cpp/types/has_unique_object_representations
+ * https://github.com/boostorg/pfr
+ *
+ * See also 20210503_bind and 20211004_layout.
+ */
@@ -0,0 +1,337 @@
+﻿/*
+ * Proxy references
+ *
+ * 20211025_soa showed that storing one array per field (a struct of arrays)
+ * is faster than one array of structs, when a loop only needs some of the
+ * fields. But it was a hand-written Portfolio class, for one specific set of
+ * fields. And you lose the nice syntax: contract.rate becomes rate[i].
+ *
+ * With the tricks of 20211227_serialization, we can find the fields of any
+ * aggregate or tuple. So, we can write a generic soa_vector<T>, that looks
+ * like a std::vector<T>, but stores every field in its own array. Element
+ * access cannot return a T&, as there is no T in memory. Instead, it returns
+ * a proxy: an object that behaves like a reference to a T. std::vector<bool>
+ * does the same.
+ *
+ * Scroll down to main() and follow the program flow.
+ */
+
+// These includes are just for this example.
+#include "bench.h"
+
+#include <cstddef>
+#include <iostream>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// The types of 20210503_bind.
+struct Module {
+	int launch;
+	char const* by = "rocket";
+};
+
+struct Tiange : Module {};
+struct Wentian : Module {};
+struct Mengtian : Module {};
+
+using Tiangong = std::tuple<Tiange, Wentian, Mengtian>;
+
+
+
+////////////////////////////////////////////
+// Fields of a type
+//
+
+// Count the fields of an aggregate by brace initialization. See
+// 20211227_serialization for the details.
+template <size_t>
+struct any_field {
+	template <typename U>
+	operator U() const;
+};
+
+template <typename T, typename Seq, typename = void>
+struct brace_constructible : std::false_type {};
+
+template <typename T, size_t... I>
+struct brace_constructible<T, std::index_sequence<I...>, std::void_t<decltype(T{any_field<I>{}...})>>
+	: std::true_type {};
+
+template <typename T, size_t N = 4>
+constexpr size_t arity()
+{
+	if constexpr(N == 0)
+		return 0;
+	else if constexpr(brace_constructible<T, std::make_index_sequence<N>>::value)
+		return N;
+	else
+		return arity<T, N - 1U>();
+}
+
+template <typename T, typename = void>
+struct is_tuple_like : std::false_type {};
+
+template <typename T>
+struct is_tuple_like<T, std::void_t<decltype(std::tuple_size<T>::value)>> : std::true_type {};
+
+// A tuple of references to all fields of t, of an aggregate or a tuple.
+template <typename T>
+constexpr auto fields(T& t)
+{
+	if constexpr(is_tuple_like<std::remove_const_t<T>>::value) {
+		return std::apply([](auto&... f) { return std::tie(f...); }, t);
+	} else {
+		constexpr size_t n = arity<std::remove_const_t<T>>();
+		if constexpr(n == 1) {
+			auto& [a] = t;
+			return std::tie(a);
+		} else if constexpr(n == 2) {
+			auto& [a, b] = t;
+			return std::tie(a, b);
+		} else if constexpr(n == 3) {
+			auto& [a, b, c] = t;
+			return std::tie(a, b, c);
+		} else {
+			static_assert(n == 4, "Unsupported number of fields");
+			auto& [a, b, c, d] = t;
+			return std::tie(a, b, c, d);
+		}
+	}
+}
+
+// The types of the fields, as a std::tuple<F...>.
+template <typename T>
+struct field_types;
+
+template <typename... F>
+struct field_types<std::tuple<F&...>> {
+	using type = std::tuple<F...>;
+};
+
+template <typename T>
+using field_types_t = typename field_types<decltype(fields(std::declval<T&>()))>::type;
+
+static_assert(std::is_same_v<field_types_t<Module>, std::tuple<int, char const*>>);
+
+
+
+////////////////////////////////////////////
+// The container
+//
+
+// A minimal std::span (which is C++20).
+template <typename T>
+class span {
+public:
+	constexpr span(T* data, size_t size) noexcept : m_data{data}, m_size{size} {}
+
+	constexpr T* begin() const noexcept { return m_data; }
+	constexpr T* end() const noexcept { return m_data + m_size; }
+	constexpr T* data() const noexcept { return m_data; }
+	constexpr size_t size() const noexcept { return m_size; }
+	constexpr T& operator[](size_t i) const noexcept { return m_data[i]; }
+
+private:
+	T* m_data;
+	size_t m_size;
+};
+
+template <typename T, typename Fields = field_types_t<T>>
+class soa_reference;
+
+// The proxy. It holds a reference to every field of one element. It can be
+// assigned a T, converted to a T, and decomposed by structured binding, just
+// like a T&.
+template <typename T, typename... F>
+class soa_reference<T, std::tuple<F...>> {
+public:
+	explicit soa_reference(F&... f) noexcept : m_fields{f...} {}
+
+	// Assignment writes through to the fields, like a reference does.
+	soa_reference const& operator=(T const& x) const
+	{
+		std::apply([&x](auto&... dst) {
+			std::apply([&dst...](auto const&... src) { ((dst = src), ...); }, fields(x));
+		}, m_fields);
+		return *this;
+	}
+
+	operator T() const
+	{
+		return std::apply([](auto const&... f) { return T{f...}; }, m_fields);
+	}
+
+	template <size_t I>
+	auto& get() const noexcept { return std::get<I>(m_fields); }
+
+private:
+	std::tuple<F&...> m_fields;
+};
+
+// The tuple protocol for the proxy. Every element is a reference, so
+// auto [launch, by] = v[i] gives references into the container.
+template <typename T, typename F>
+struct std::tuple_size<soa_reference<T, F>> : std::tuple_size<F> {};
+
+template <size_t I, typename T, typename F>
+struct std::tuple_element<I, soa_reference<T, F>> {
+	using type = std::tuple_element_t<I, F>&;
+};
+
+template <typename T, typename Fields = field_types_t<T>>
+class soa_vector;
+
+template <typename T, typename... F>
+class soa_vector<T, std::tuple<F...>> {
+public:
+	using value_type = T;
+	using reference = soa_reference<T>;
+
+	template <size_t I>
+	using column_type = std::tuple_element_t<I, std::tuple<F...>>;
+
+	void push_back(T const& x)
+	{
+		push_back(x, std::index_sequence_for<F...>{});
+	}
+
+	void reserve(size_t n)
+	{
+		std::apply([n](auto&... c) { (c.reserve(n), ...); }, m_columns);
+	}
+
+	size_t size() const noexcept { return std::get<0>(m_columns).size(); }
+	bool empty() const noexcept { return size() == 0; }
+
+	reference operator[](size_t i) noexcept
+	{
+		return std::apply([i](auto&... c) { return reference{c[i]...}; }, m_columns);
+	}
+
+	T operator[](size_t i) const
+	{
+		return std::apply([i](auto const&... c) { return T{c[i]...}; }, m_columns);
+	}
+
+	// Direct access to all values of one field. This is where the speed
+	// comes from: a plain array of one type, without gaps.
+	template <size_t I>
+	span<column_type<I>> column() noexcept
+	{
+		auto& c = std::get<I>(m_columns);
+		return {c.data(), c.size()};
+	}
+
+	template <size_t I>
+	span<column_type<I> const> column() const noexcept
+	{
+		auto const& c = std::get<I>(m_columns);
+		return {c.data(), c.size()};
+	}
+
+private:
+	template <size_t... I>
+	void push_back(T const& x, std::index_sequence<I...>)
+	{
+		auto f = fields(x);
+		(std::get<I>(m_columns).push_back(std::get<I>(f)), ...);
+	}
+
+	std::tuple<std::vector<F>...> m_columns;
+};
+
+int main(int argc, char** argv)
+{
+	soa_vector<Module> modules;
+	modules.push_back({1998, "Proton-K"});
+	modules.push_back({1998, "Endeavour"});
+	modules.push_back({2001, "Atlantis"});
+	modules.push_back({2007, "Discovery"});
+
+	// It looks like a vector of Modules...
+	auto [launch, by] = modules[0];
+	std::cout << "First module launched in " << launch << " by " << by << std::endl;
+
+	// ...and the bindings are references, like they would be for auto&.
+	launch = 1999;
+	if(modules.column<0>()[0] != 1999)
+		return 1;
+
+	modules[0] = Module{1998, "Proton-K"};
+	Module destiny = modules[2];
+	std::cout << "Destiny launched in " << destiny.launch << " by " << destiny.by << std::endl;
+
+	// Tuples work too. Every element of a Tiangong gets its own column.
+	soa_vector<Tiangong> stations;
+	stations.push_back({{{2021, "Long March 5B"}}, {{2022}}, {{2022}}});
+	auto [tiange, wentian, mengtian] = stations[0];
+	mengtian.launch = 2023;
+	std::cout << "Tiange launched by " << tiange.by << ", Mengtian in "
+		<< stations.column<2>()[0].launch << std::endl;
+
+	// Note that this does not work:
+	//
+	// for(auto& m : modules)
+	//
+	// A proxy is not a reference, and a temporary cannot bind to auto&.
+	// That is why range-for over std::vector<bool> requires auto&&. We
+	// did not even give soa_vector iterators; columns are the way to go.
+
+
+
+	size_t n = bench::scale(argc, argv, 1'000'000);
+	std::vector<Module> aos;
+	soa_vector<Module> soa;
+	aos.reserve(n);
+	soa.reserve(n);
+	for(size_t i = 0; i < n; i++) {
+		Module m{1998 + static_cast<int>(i % 30U), "Falcon-9"};
+		aos.push_back(m);
+		soa.push_back(m);
+	}
+
+	std::cout << std::endl << n << " Modules, sum of all launch years:" << std::endl;
+
+	long long sum_aos = 0;
+	bench::measure("std::vector<Module>", n, [&] {
+		for(auto const& m : aos)
+			sum_aos += m.launch;
+		bench::escape(sum_aos);
+	});
+
+	long long sum_proxy = 0;
+	bench::measure("soa_vector<Module>, proxies", n, [&] {
+		for(size_t i = 0; i < n; i++) {
+			auto [l, b] = soa[i];
+			sum_proxy += l;
+		}
+		bench::escape(sum_proxy);
+	});
+
+	long long sum_column = 0;
+	bench::measure("soa_vector<Module>, column", n, [&] {
+		for(auto l : soa.column<0>())
+			sum_column += l;
+		bench::escape(sum_column);
+	});
+
+	if(sum_aos != sum_column || sum_proxy != sum_column)
+		return 1;
+
+	// A Module is 16 bytes, of which 4 are the launch year, and 4 are
+	// padding. The column only holds the years: a quarter of the memory
+	// to go through, and an int array is ideal for vector instructions.
+	// With optimization, the proxies disappear completely, and the loop
+	// over proxies is as fast as the column. Without, it is the slowest.
+}
+
+/*
+ * Further reading:
+ *
+ * https://en.cppreference.com/w/cpp/container/vector_bool
+ * https://en.wikipedia.org/wiki/AoS_and_SoA
+ *
+ * See also 20210503_bind, 20211025_soa and 20211227_serialization.
+ */
@@ -0,0 +1,447 @@
+﻿/*
+ * Compressed sparse row graphs
+ *
+ * The ISS of 20210503_bind is a graph: modules, connected by
+ * std::pair<Module&, Module&>. For six modules, that is perfect. But what if
+ * you want to know which modules are reachable from the airlock, or the
+ * shortest way from one end of a station to the other, and the station has a
+ * million modules? A list of pairs does not tell you the neighbors of a
+ * module, unless you go through all pairs.
+ *
+ * The classic fix is to give every module a list of pointers to its
+ * neighbors. That works, but every module is a separate allocation, and
+ * every step through the graph is a jump through memory. Compressed sparse
+ * row (CSR) stores the same in two plain arrays: all neighbors of module 0,
+ * then all neighbors of module 1, and so on, with an array of offsets where
+ * every module starts.
+ *
+ * Scroll down to main() and follow the program flow.
+ */
+
+// These includes are just for this example.
+#include "bench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <queue>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// The Module of 20210503_bind.
+struct Module {
+	int launch;
+	char const* by = "rocket";
+};
+
+// A connection between the modules with the given indices.
+using Connection = std::pair<uint32_t, uint32_t>;
+
+
+
+////////////////////////////////////////////
+// The graph
+//
+
+// The neighbors of a module: a part of the targets array.
+class neighbors {
+public:
+	constexpr neighbors(uint32_t const* begin, uint32_t const* end) noexcept : m_begin{begin}, m_end{end} {}
+
+	constexpr uint32_t const* begin() const noexcept { return m_begin; }
+	constexpr uint32_t const* end() const noexcept { return m_end; }
+	constexpr size_t size() const noexcept { return static_cast<size_t>(m_end - m_begin); }
+
+private:
+	uint32_t const* m_begin;
+	uint32_t const* m_end;
+};
+
+struct components {
+	std::vector<uint32_t> id;
+	uint32_t count = 0;
+};
+
+class module_graph {
+public:
+	static constexpr uint32_t unreached = std::numeric_limits<uint32_t>::max();
+
+	// Connections are undirected: both modules become a neighbor of each
+	// other. Building is a counting sort: count the neighbors of every
+	// module, compute where every module starts, and fill in.
+	module_graph(std::vector<Module> modules, std::vector<Connection> const& connections)
+		: m_modules{std::move(modules)}
+		, m_offsets(m_modules.size() + 1U)
+		, m_targets(connections.size() * 2U)
+	{
+		if(m_modules.size() >= unreached)
+			throw std::length_error{"Too many modules"};
+
+		for(auto [a, b] : connections) {
+			if(a >= m_modules.size() || b >= m_modules.size())
+				throw std::out_of_range{"Connection to unknown module"};
+			m_offsets[a + 1U]++;
+			m_offsets[b + 1U]++;
+		}
+
+		for(size_t i = 1; i < m_offsets.size(); i++)
+			m_offsets[i] += m_offsets[i - 1U];
+
+		std::vector<uint32_t> fill(m_offsets.begin(), m_offsets.end() - 1);
+		for(auto [a, b] : connections) {
+			m_targets[fill[a]++] = b;
+			m_targets[fill[b]++] = a;
+		}
+	}
+
+	size_t size() const noexcept { return m_modules.size(); }
+	Module const& operator[](uint32_t i) const noexcept { return m_modules[i]; }
+
+	neighbors neighbors_of(uint32_t i) const noexcept
+	{
+		return {m_targets.data() + m_offsets[i], m_targets.data() + m_offsets[i + 1U]};
+	}
+
+	// Breadth-first search. Returns the number of hops from source to every
+	// module, or unreached.
+	std::vector<uint32_t> bfs(uint32_t source) const
+	{
+		std::vector<uint32_t> dist(size(), unreached);
+		std::vector<uint32_t> queue;
+		queue.reserve(size());
+
+		dist[source] = 0;
+		queue.push_back(source);
+		// The queue is a vector that is never popped: everything before
+		// head has been visited.
+		for(size_t head = 0; head < queue.size(); head++) {
+			uint32_t v = queue[head];
+			for(uint32_t w : neighbors_of(v))
+				if(dist[w] == unreached) {
+					dist[w] = dist[v] + 1U;
+					queue.push_back(w);
+				}
+		}
+
+		return dist;
+	}
+
+	// Depth-first search, calling visit(i) for every module reachable from
+	// source, in pre-order. No recursion, as a long chain of modules would
+	// overflow the stack.
+	template <typename F>
+	void dfs(uint32_t source, F&& visit) const
+	{
+		std::vector<bool> seen(size());
+		std::vector<uint32_t> stack{source};
+
+		while(!stack.empty()) {
+			uint32_t v = stack.back();
+			stack.pop_back();
+			if(seen[v])
+				continue;
+
+			seen[v] = true;
+			visit(v);
+
+			// Push in reverse, such that the first neighbor is visited first.
+			auto n = neighbors_of(v);
+			for(auto it = n.end(); it != n.begin(); --it)
+				if(!seen[*(it - 1)])
+					stack.push_back(*(it - 1));
+		}
+	}
+
+	// Label every module with the index of its connected component.
+	components connected_components() const
+	{
+		components c{std::vector<uint32_t>(size(), unreached), 0};
+		std::vector<uint32_t> queue;
+		queue.reserve(size());
+
+		for(uint32_t s = 0; s < size(); s++) {
+			if(c.id[s] != unreached)
+				continue;
+
+			queue.clear();
+			queue.push_back(s);
+			c.id[s] = c.count;
+			for(size_t head = 0; head < queue.size(); head++)
+				for(uint32_t w : neighbors_of(queue[head]))
+					if(c.id[w] == unreached) {
+						c.id[w] = c.count;
+						queue.push_back(w);
+					}
+
+			c.count++;
+		}
+
+		return c;
+	}
+
+	// The modules on a shortest path from source to target, both
+	// included, or nothing if there is no path. All connections have the
+	// same length, so a BFS that remembers where it came from suffices.
+	std::vector<uint32_t> shortest_path(uint32_t source, uint32_t target) const
+	{
+		std::vector<uint32_t> parent(size(), unreached);
+		std::vector<uint32_t> queue{source};
+		parent[source] = source;
+
+		for(size_t head = 0; head < queue.size() && parent[target] == unreached; head++)
+			for(uint32_t w : neighbors_of(queue[head]))
+				if(parent[w] == unreached) {
+					parent[w] = queue[head];
+					queue.push_back(w);
+				}
+
+		std::vector<uint32_t> path;
+		if(parent[target] == unreached)
+			return path;
+
+		for(uint32_t v = target; v != source; v = parent[v])
+			path.push_back(v);
+		path.push_back(source);
+		std::reverse(path.begin(), path.end());
+		return path;
+	}
+
+	// BFS, level by level. Every thread expands a part of the current
+	// frontier. A module is claimed by the thread that first sets its
+	// distance; compare_exchange makes sure only one does. As all
+	// modules of a level get the same distance, the result is the same as
+	// bfs(), regardless of which thread wins.
+	std::vector<uint32_t> parallel_bfs(uint32_t source, unsigned threads) const
+	{
+		std::unique_ptr<std::atomic<uint32_t>[]> dist{new std::atomic<uint32_t>[size()]};
+		for(size_t i = 0; i < size(); i++)
+			dist[i].store(unreached, std::memory_order_relaxed);
+
+		dist[source].store(0, std::memory_order_relaxed);
+		std::vector<uint32_t> frontier{source};
+		std::vector<std::vector<uint32_t>> next(threads);
+
+		auto expand = [&](uint32_t level, size_t begin, size_t end, std::vector<uint32_t>& out) {
+			for(size_t i = begin; i < end; i++)
+				for(uint32_t w : neighbors_of(frontier[i])) {
+					uint32_t expected = unreached;
+					if(dist[w].load(std::memory_order_relaxed) == unreached &&
+						dist[w].compare_exchange_strong(expected, level, std::memory_order_relaxed))
+						out.push_back(w);
+				}
+		};
+
+		for(uint32_t level = 1; !frontier.empty(); level++) {
+			// Starting threads is not free. Small frontiers, like the
+			// first levels, are done on this thread.
+			unsigned t_count = frontier.size() < 4096U ? 1U : threads;
+			for(auto& n : next)
+				n.clear();
+
+			if(t_count == 1) {
+				expand(level, 0, frontier.size(), next[0]);
+			} else {
+				std::vector<std::thread> workers;
+				for(unsigned t = 0; t < t_count; t++)
+					workers.emplace_back([&, t] {
+						expand(level, frontier.size() * t / t_count,
+							frontier.size() * (t + 1U) / t_count, next[t]);
+					});
+				for(auto& w : workers)
+					w.join();
+			}
+
+			frontier.clear();
+			for(auto const& n : next)
+				frontier.insert(frontier.end(), n.begin(), n.end());
+		}
+
+		std::vector<uint32_t> result(size());
+		for(size_t i = 0; i < size(); i++)
+			result[i] = dist[i].load(std::memory_order_relaxed);
+		return result;
+	}
+
+private:
+	std::vector<Module> m_modules;
+	// The neighbors of module i are m_targets[m_offsets[i]] up to
+	// m_targets[m_offsets[i + 1]].
+	std::vector<uint32_t> m_offsets;
+	std::vector<uint32_t> m_targets;
+};
+
+
+
+////////////////////////////////////////////
+// The pointer-based graph
+//
+
+// For comparison: every module is a separate object, with pointers to its
+// neighbors. This is what you get when you turn the pairs of references of
+// 20210503_bind into something you can traverse.
+struct Node {
+	Module module;
+	std::vector<Node*> links;
+	uint32_t dist = module_graph::unreached;
+};
+
+static std::vector<std::unique_ptr<Node>> pointer_graph(std::vector<Module> const& modules,
+	std::vector<Connection> const& connections)
+{
+	// Allocate the nodes in a scrambled order. A station that has been
+	// changed for years is not laid out in order in memory either.
+	std::vector<size_t> order(modules.size());
+	std::iota(order.begin(), order.end(), size_t{0});
+	std::shuffle(order.begin(), order.end(), std::mt19937{2022});
+
+	std::vector<std::unique_ptr<Node>> nodes(modules.size());
+	for(auto i : order)
+		nodes[i] = std::make_unique<Node>(Node{modules[i], {}});
+
+	for(auto [a, b] : connections) {
+		nodes[a]->links.push_back(nodes[b].get());
+		nodes[b]->links.push_back(nodes[a].get());
+	}
+
+	return nodes;
+}
+
+static void pointer_bfs(Node* source)
+{
+	std::queue<Node*> queue;
+	source->dist = 0;
+	queue.push(source);
+	while(!queue.empty()) {
+		Node* v = queue.front();
+		queue.pop();
+		for(Node* w : v->links)
+			if(w->dist == module_graph::unreached) {
+				w->dist = v->dist + 1U;
+				queue.push(w);
+			}
+	}
+}
+
+// A station of n modules. Like the ISS, every new module is attached to an
+// existing one, and some modules are connected to more than one. The
+// modules are divided over the given number of separate stations.
+static std::vector<Connection> station(uint32_t n, uint32_t stations)
+{
+	std::vector<Connection> connections;
+	uint32_t x = 1;
+	auto random = [&x](uint32_t below) {
+		x = x * 1664525U + 1013904223U;
+		return static_cast<uint32_t>((uint64_t{x} * below) >> 32U);
+	};
+
+	for(uint32_t s = 0; s < stations; s++) {
+		auto first = static_cast<uint32_t>(uint64_t{n} * s / stations);
+		auto last = static_cast<uint32_t>(uint64_t{n} * (s + 1U) / stations);
+		for(uint32_t i = first + 1U; i < last; i++) {
+			connections.emplace_back(first + random(i - first), i);
+			if(random(4) == 0)
+				connections.emplace_back(first + random(i - first), i);
+		}
+	}
+
+	return connections;
+}
+
+int main(int argc, char** argv)
+{
+	// The ISS of 20210503_bind, with indices instead of references.
+	enum { zarya, unity, destiny, harmony, tranquility, beam };
+	module_graph iss{
+		{{1998, "Proton-K"}, {1998, "Endeavour"}, {2001, "Atlantis"},
+			{2007, "Discovery"}, {2010, "Endeavour"}, {2016, "Falcon-9"}},
+		{{zarya, unity}, {unity, destiny}, {destiny, harmony}, {unity, tranquility},
+			{tranquility, beam}}};
+
+	// From Zarya to BEAM: via Unity and Tranquility.
+	auto path = iss.shortest_path(zarya, beam);
+	std::cout << "Zarya to BEAM:";
+	for(auto m : path)
+		std::cout << " " << iss[m].launch;
+	std::cout << std::endl;
+
+	if(path != std::vector<uint32_t>{zarya, unity, tranquility, beam})
+		return 1;
+
+	std::cout << "Depth-first from Zarya:";
+	iss.dfs(zarya, [&](uint32_t m) { std::cout << " " << iss[m].by; });
+	std::cout << std::endl;
+
+
+
+	// A big one. Try 10000000.
+	auto n = static_cast<uint32_t>(bench::scale(argc, argv, 100'000));
+	std::vector<Module> modules(n, Module{2022, "Long March 5B"});
+	uint32_t const stations = 4;
+	auto connections = station(n, stations);
+
+	module_graph g{modules, connections};
+	auto nodes = pointer_graph(modules, connections);
+
+	std::cout << std::endl << n << " modules, " << connections.size() << " connections:" << std::endl;
+
+	// A BFS from module 0 visits the first station only.
+	size_t const reached = n / stations;
+	std::vector<uint32_t> dist;
+	bench::measure("BFS, CSR", reached, [&] {
+		dist = g.bfs(0);
+	});
+
+	bench::measure("BFS, pointers", reached, [&] {
+		pointer_bfs(nodes[0].get());
+	});
+
+	for(uint32_t i = 0; i < n; i++)
+		if(nodes[i]->dist != dist[i])
+			return 1;
+
+	unsigned threads = std::max(1U, std::thread::hardware_concurrency());
+	std::vector<uint32_t> parallel;
+	bench::measure("BFS, CSR, parallel", reached, [&] {
+		parallel = g.parallel_bfs(0, threads);
+	});
+
+	if(parallel != dist)
+		return 1;
+
+	components c;
+	bench::measure("connected components", n, [&] {
+		c = g.connected_components();
+	});
+
+	std::cout << c.count << " components, " << threads << " threads" << std::endl;
+	if(c.count != stations)
+		return 1;
+
+	// The CSR graph takes 4 bytes per connection end and 4 per module,
+	// next to the modules themselves. The pointer graph takes 8 bytes per
+	// connection end, a vector of 24 bytes per module, and the overhead of
+	// a separate allocation per module and per vector. And the modules
+	// cannot be scanned as an array anymore.
+	//
+	// Connections between random modules make any traversal jump through
+	// memory, in both representations. CSR jumps less, and through less
+	// memory. The parallel BFS pays for atomics, so it only wins when
+	// there are cores to share the work.
+}
+
+/*
+ * Further reading:
+ *
+ * https://en.wikipedia.org/wiki/Sparse_matrix#Compressed_sparse_row_(CSR,_CRS_or_Yale_format)
+ * https://en.wikipedia.org/wiki/Breadth-first_search
+ *
+ * See also 20210503_bind and 20220103_soa_vector.
+ */
@@ -0,0 +1,433 @@
+﻿/*
+ * Coalitions
+ *
+ * 20210322_tuple sums the seats of a few coalitions, known at compile time.
+ * But after an election, the question is the other way around: which
+ * coalitions have a majority at all? With 17 parties, there are 131072
+ * combinations. Most of them are useless: a coalition that still has a
+ * majority when one party leaves, does not need that party. The interesting
+ * ones are the minimal winning coalitions: every party is needed.
+ *
+ * Checking all combinations is fast when you do it right: walk through them
+ * in such an order that only one party joins or leaves at a time, and split
+ * the work over threads. But every party more doubles the work. Beyond 30
+ * parties, you need to skip combinations that cannot work, or count them
+ * without listing them at all.
+ *
+ * Scroll down to main() and follow the program flow.
+ */
+
+// These includes are just for this example.
+#include "bench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+struct Party {
+	std::string_view name;
+	int seats;
+};
+
+// A coalition is a set of parties: bit i is set when party i is in.
+using Coalition = uint64_t;
+
+// The index of the lowest and highest set bit of x, which must not be 0.
+static unsigned lowest_bit(uint64_t x) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return static_cast<unsigned>(__builtin_ctzll(x));
+#else
+	unsigned i = 0;
+	for(; (x & 1U) == 0; x >>= 1U)
+		i++;
+	return i;
+#endif
+}
+
+static unsigned highest_bit(uint64_t x) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return 63U - static_cast<unsigned>(__builtin_clzll(x));
+#else
+	unsigned i = 0;
+	while(x >>= 1U)
+		i++;
+	return i;
+#endif
+}
+
+static unsigned count_bits(uint64_t x) noexcept
+{
+	unsigned n = 0;
+	for(; x != 0; x &= x - 1U)
+		n++;
+	return n;
+}
+
+// The outcome of a search. The sum of the coalitions is a cheap way to check
+// that two searches found the same set, regardless of the order.
+struct search_result {
+	uint64_t count = 0;
+	uint64_t visited = 0;
+	uint64_t sum = 0;
+
+	search_result& operator+=(search_result const& r) noexcept
+	{
+		count += r.count;
+		visited += r.visited;
+		sum += r.sum;
+		return *this;
+	}
+};
+
+// Run task(i, result) for all i in [0, tasks), on the given number of threads.
+// Threads take the next task when they are done, as some tasks are much
+// bigger than others.
+template <typename F>
+static search_result parallel(size_t tasks, unsigned threads, F&& task)
+{
+	std::atomic<size_t> next{0};
+	std::vector<search_result> results(threads);
+	std::vector<std::thread> workers;
+
+	for(unsigned t = 0; t < threads; t++)
+		workers.emplace_back([&, t] {
+			size_t i = next.fetch_add(1, std::memory_order_relaxed);
+			for(; i < tasks; i = next.fetch_add(1, std::memory_order_relaxed))
+				task(i, results[t]);
+		});
+
+	for(auto& w : workers)
+		w.join();
+
+	search_result total;
+	for(auto const& r : results)
+		total += r;
+	return total;
+}
+
+
+
+////////////////////////////////////////////
+// The parliament
+//
+
+class parliament {
+public:
+	static constexpr size_t max_parties = 64;
+
+	// The parties are sorted by seats, largest first. That way, the party
+	// with the highest index in a coalition has the fewest seats. A
+	// winning coalition is minimal when it is not winning without that
+	// party.
+	parliament(std::vector<Party> parties, int quota)
+		: m_parties{std::move(parties)}
+		, m_quota{quota}
+	{
+		if(m_parties.size() > max_parties)
+			throw std::length_error{"Too many parties"};
+		if(quota <= 0)
+			throw std::invalid_argument{"Invalid quota"};
+
+		std::stable_sort(m_parties.begin(), m_parties.end(),
+			[](Party const& a, Party const& b) { return a.seats > b.seats; });
+
+		m_prefix.push_back(0);
+		for(auto const& p : m_parties) {
+			if(p.seats <= 0)
+				throw std::invalid_argument{"Invalid number of seats"};
+			m_prefix.push_back(m_prefix.back() + p.seats);
+		}
+	}
+
+	size_t size() const noexcept { return m_parties.size(); }
+	int quota() const noexcept { return m_quota; }
+	Party const& operator[](size_t i) const noexcept { return m_parties[i]; }
+
+	int seats(Coalition c) const noexcept
+	{
+		int s = 0;
+		for(; c != 0; c &= c - 1U)
+			s += m_parties[lowest_bit(c)].seats;
+		return s;
+	}
+
+	std::string names(Coalition c) const
+	{
+		std::string s;
+		for(; c != 0; c &= c - 1U) {
+			if(!s.empty())
+				s += " + ";
+			s += m_parties[lowest_bit(c)].name;
+		}
+		return s;
+	}
+
+	// Try all 2^n coalitions, in Gray code order: coalition i is
+	// i ^ (i >> 1), which differs in exactly one party from the previous
+	// one. So, the seats are updated by one addition or subtraction, not
+	// recomputed. The first prefix_bits parties (the small ones, at the
+	// high bits) are fixed per task, and the tasks are spread over the
+	// threads.
+	search_result gray(unsigned threads, unsigned prefix_bits = 6) const
+	{
+		auto n = static_cast<unsigned>(size());
+		prefix_bits = std::min(prefix_bits, n);
+		unsigned const low = n - prefix_bits;
+
+		return parallel(size_t{1} << prefix_bits, threads, [&](size_t task, search_result& r) {
+			Coalition const prefix = static_cast<Coalition>(task) << low;
+			int s = seats(prefix);
+			Coalition g = 0;
+			uint64_t const end = uint64_t{1} << low;
+
+			for(uint64_t i = 0;;) {
+				Coalition c = prefix | g;
+				if(s >= m_quota && s - m_parties[highest_bit(c)].seats < m_quota) {
+					r.count++;
+					r.sum += c;
+				}
+
+				if(++i == end)
+					break;
+
+				// The party that joins or leaves.
+				unsigned b = lowest_bit(i);
+				g ^= Coalition{1} << b;
+				s += ((g >> b) & 1U) != 0 ? m_parties[b].seats : -m_parties[b].seats;
+			}
+
+			r.visited += end;
+		});
+	}
+
+	// Depth-first search over the parties, largest first, with at most
+	// max_size parties per coalition. A branch is cut off when a party
+	// makes it winning (any party more would make it non-minimal), or when
+	// the largest parties that could still join do not bring a majority.
+	// The branches at the given depth are the tasks for the threads.
+	search_result search(unsigned threads, size_t max_size, size_t depth = 8) const
+	{
+		max_size = std::min(max_size, size());
+		depth = std::min(depth, size());
+
+		// Collect the branches at depth, and the coalitions found before.
+		std::vector<std::tuple<Coalition, int, size_t>> branches;
+		search_result shallow;
+		descend(0, 0, 0, 0, max_size, depth, shallow,
+			[&](Coalition c, int s, size_t k) { branches.emplace_back(c, s, k); });
+
+		search_result deep = parallel(branches.size(), threads, [&](size_t task, search_result& r) {
+			auto [c, s, k] = branches[task];
+			descend(depth, c, s, k, max_size, size(), r, [](Coalition, int, size_t) {});
+		});
+
+		return shallow += deep;
+	}
+
+	// All minimal winning coalitions of at most max_size parties.
+	std::vector<Coalition> list(size_t max_size) const
+	{
+		std::vector<Coalition> all;
+		collect(0, 0, 0, 0, std::min(max_size, size()), all);
+		return all;
+	}
+
+	// Count the minimal winning coalitions of at most max_size parties
+	// without enumerating them. ways[k][s] is the number of coalitions of
+	// the parties seen so far, with k parties and s seats, that do not have
+	// a majority yet. A coalition that reaches the quota when adding party j
+	// is minimal, as j has the fewest seats.
+	uint64_t count(size_t max_size) const
+	{
+		max_size = std::min(max_size, size());
+		auto q = static_cast<size_t>(m_quota);
+		if(max_size == 0 || q == 0)
+			return 0;
+
+		std::vector<std::vector<uint64_t>> ways(max_size, std::vector<uint64_t>(q));
+		ways[0][0] = 1;
+		uint64_t total = 0;
+
+		for(auto const& p : m_parties) {
+			auto seats = static_cast<size_t>(p.seats);
+			// Backwards, such that every party is used once.
+			for(size_t k = max_size; k > 0; k--)
+				for(size_t s = 0; s < q; s++) {
+					uint64_t w = ways[k - 1U][s];
+					if(w == 0)
+						continue;
+					if(s + seats >= q)
+						total += w;
+					else if(k < max_size)
+						ways[k][s + seats] += w;
+				}
+		}
+
+		return total;
+	}
+
+private:
+	// Add the seats of the next r parties, starting at j, to see whether a
+	// majority is still possible.
+	int best(size_t j, size_t r) const noexcept
+	{
+		size_t end = std::min(size(), j + r);
+		return m_prefix[end] - m_prefix[j];
+	}
+
+	// Invariant: s < quota, and c has k parties, all before j. Branches
+	// that reach depth are handed to branch(), instead of descending.
+	template <typename Branch>
+	void descend(size_t j, Coalition c, int s, size_t k, size_t max_size, size_t depth,
+		search_result& r, Branch&& branch) const
+	{
+		if(j == depth) {
+			branch(c, s, k);
+			return;
+		}
+
+		r.visited++;
+		if(k == max_size || j == size() || s + best(j, max_size - k) < m_quota)
+			return;
+
+		Coalition with = c | (Coalition{1} << j);
+		int sw = s + m_parties[j].seats;
+		if(sw >= m_quota) {
+			r.count++;
+			r.sum += with;
+		} else {
+			descend(j + 1U, with, sw, k + 1U, max_size, depth, r, branch);
+		}
+
+		descend(j + 1U, c, s, k, max_size, depth, r, branch);
+	}
+
+	void collect(size_t j, Coalition c, int s, size_t k, size_t max_size,
+		std::vector<Coalition>& out) const
+	{
+		if(k == max_size || j == size() || s + best(j, max_size - k) < m_quota)
+			return;
+
+		Coalition with = c | (Coalition{1} << j);
+		int sw = s + m_parties[j].seats;
+		if(sw >= m_quota)
+			out.push_back(with);
+		else
+			collect(j + 1U, with, sw, k + 1U, max_size, out);
+
+		collect(j + 1U, c, s, k, max_size, out);
+	}
+
+	std::vector<Party> m_parties;
+	std::vector<int> m_prefix;
+	int m_quota;
+};
+
+// A fictional parliament of n parties and 150 seats. Few large parties, and a
+// long tail of small ones.
+static parliament fictional(size_t n)
+{
+	static constexpr std::string_view name = "P";
+	std::vector<Party> parties;
+	int left = 150;
+	for(size_t i = 0; i < n; i++) {
+		int s = std::max(1, left / 4);
+		if(i + 1U == n || left - s < static_cast<int>(n - i - 1U))
+			s = std::max(1, left - static_cast<int>(n - i - 1U));
+		parties.push_back({name, s});
+		left -= s;
+	}
+	return parliament{std::move(parties), 76};
+}
+
+int main(int argc, char** argv)
+{
+	// The Dutch elections of March 2021.
+	parliament tk2021{{
+		{"VVD", 34}, {"D66", 24}, {"PVV", 17}, {"CDA", 15}, {"SP", 9},
+		{"PvdA", 9}, {"GL", 8}, {"FvD", 8}, {"PvdD", 6}, {"CU", 5},
+		{"Volt", 3}, {"JA21", 3}, {"SGP", 3}, {"DENK", 3}, {"50PLUS", 1},
+		{"BBB", 1}, {"BIJ1", 1}}, 76};
+
+	// Fewest parties first, then the smallest majority.
+	auto all = tk2021.list(tk2021.size());
+	std::sort(all.begin(), all.end(), [&](Coalition a, Coalition b) {
+		return std::tuple{count_bits(a), tk2021.seats(a)} < std::tuple{count_bits(b), tk2021.seats(b)};
+	});
+
+	std::cout << all.size() << " minimal winning coalitions, the first 10:" << std::endl;
+	for(size_t i = 0; i < std::min<size_t>(10, all.size()); i++)
+		std::cout << "  " << tk2021.seats(all[i]) << ": " << tk2021.names(all[i]) << std::endl;
+
+	// All methods agree.
+	unsigned threads = std::max(1U, std::thread::hardware_concurrency());
+	auto g = tk2021.gray(threads);
+	auto s = tk2021.search(threads, tk2021.size());
+	if(g.count != all.size() || s.count != all.size() || g.sum != s.sum ||
+		tk2021.count(tk2021.size()) != all.size() || tk2021.count(0) != 0)
+		return 1;
+
+
+
+	// A parliament with more parties. Try 28 for the Gray code, or 60 for
+	// the search.
+	size_t n = bench::scale(argc, argv, 20);
+	auto p = fictional(n);
+	std::cout << std::endl << n << " parties, " << threads << " threads:" << std::endl;
+
+	// The Gray code visits every coalition, so the time per coalition is
+	// what matters.
+	if(n <= 32) {
+		search_result r;
+		bench::measure("Gray code, all coalitions", size_t{1} << n, [&] {
+			r = p.gray(threads);
+		});
+		std::cout << "  " << r.count << " minimal winning coalitions" << std::endl;
+	}
+
+	// Only coalitions of at most 6 parties, which is realistic. The search
+	// only visits the branches that can still lead to one, so here, the
+	// time per coalition found is what matters. Counting tells how many
+	// there are.
+	size_t const max_size = 6;
+	uint64_t counted = p.count(max_size);
+
+	search_result r;
+	bench::measure("search, at most 6 parties", counted, [&] {
+		r = p.search(threads, max_size);
+	});
+	std::cout << "  " << r.count << " minimal winning coalitions, " << r.visited << " branches" << std::endl;
+
+	bench::measure("count, at most 6 parties", counted, [&] {
+		bench::escape(p.count(max_size));
+	});
+
+	if(counted != r.count)
+		return 1;
+
+	// The Gray code costs a few instructions per coalition, but there are
+	// 2^n of them. The search costs more per branch, but with the limit on
+	// the number of parties, the branches grow polynomially in n. And if
+	// you only need the number, counting takes n * size * quota steps.
+}
+
+/*
+ * Further reading:
+ *
+ * https://en.wikipedia.org/wiki/Gray_code
+ * https://en.wikipedia.org/wiki/Subset_sum_problem
+ * https://en.wikipedia.org/wiki/Coalition_government
+ *
+ * See also 20210322_tuple.
+ */
@@ -0,0 +1,426 @@
+﻿/*
+ * Visiting std::any
+ *
+ * show() of 20210517_any tries any_cast<int>, then any_cast<char const*>,
+ * then any_cast<std::string>. Every attempt compares the type_info of the
+ * contents with the one requested. Three types is fine, but with fifty,
+ * the last type needs fifty comparisons. And depending on the platform, a
+ * type_info comparison may be a string comparison of the type names.
+ *
+ * Instead, register a handler per type, and look up the handler by the type
+ * of the contents. A std::unordered_map on std::type_index does that in
+ * constant time. A table without collisions, built once at startup, does it
+ * faster. And if you attach your own tag to the values, you do not need any
+ * type_info at all: the tag mode even works when compiled with -fno-rtti.
+ *
+ * Scroll down to main() and follow the program flow.
+ */
+
+// These includes are just for this example.
+#include "bench.h"
+
+#include <any>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Compile with -fno-rtti, and only the tag mode is left.
+#if defined(__GXX_RTTI) || defined(_CPPRTTI) || defined(__cpp_rtti)
+#  define HAVE_RTTI 1
+#  include <typeindex>
+#  include <typeinfo>
+#  include <unordered_map>
+#else
+#  define HAVE_RTTI 0
+#endif
+
+
+
+////////////////////////////////////////////
+// Tags
+//
+
+// Every type gets a number, in order of first use: 0, 1, 2, ... The numbers
+// are dense, so they can index an array directly.
+inline size_t next_type_id() noexcept
+{
+	static std::atomic<size_t> next{0};
+	return next.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename T>
+size_t type_id() noexcept
+{
+	static size_t const id = next_type_id();
+	return id;
+}
+
+// A std::any that remembers the number of the type it was created with.
+class tagged_any {
+public:
+	template <typename T, std::enable_if_t<!std::is_same_v<std::decay_t<T>, tagged_any>, int> = 0>
+	tagged_any(T&& value)
+		: m_tag{type_id<std::decay_t<T>>()}
+		, m_value{std::forward<T>(value)}
+	{}
+
+	size_t tag() const noexcept { return m_tag; }
+	std::any const& value() const noexcept { return m_value; }
+
+private:
+	size_t m_tag;
+	std::any m_value;
+};
+
+
+
+////////////////////////////////////////////
+// The visitor
+//
+
+class any_visitor {
+public:
+	using handler_type = std::function<void(std::any const&)>;
+
+	// Register f for values of type T. f is called with a T const&. When
+	// T already has a handler, f replaces it. Without RTTI, std::any_cast
+	// still works; it compares the manager function of the std::any
+	// instead of its type_info.
+	template <typename T, typename F>
+	any_visitor& on(F&& f)
+	{
+		handler_type h = [f = std::forward<F>(f)](std::any const& a) { f(*std::any_cast<T>(&a)); };
+
+		size_t tag = type_id<T>();
+		if(tag >= m_by_tag.size())
+			m_by_tag.resize(tag + 1U, none);
+
+		if(m_by_tag[tag] != none) {
+			m_handlers[m_by_tag[tag]].f = std::move(h);
+			return *this;
+		}
+
+		size_t i = m_handlers.size();
+#if HAVE_RTTI
+		m_handlers.push_back({&typeid(T), std::move(h)});
+		m_by_type.emplace(typeid(T), i);
+#else
+		m_handlers.push_back({std::move(h)});
+#endif
+		m_by_tag[tag] = i;
+#if HAVE_RTTI
+		build();
+#endif
+		return *this;
+	}
+
+	// Register f for values of all other types, and empty ones.
+	template <typename F>
+	any_visitor& otherwise(F&& f)
+	{
+		m_otherwise = std::forward<F>(f);
+		return *this;
+	}
+
+	// The tag mode: an index in an array, and no type_info at all.
+	void operator()(tagged_any const& a) const
+	{
+		size_t i = a.tag() < m_by_tag.size() ? m_by_tag[a.tag()] : none;
+		call(i, a.value());
+	}
+
+#if HAVE_RTTI
+	// Look up the handler in the table without collisions. The table is
+	// keyed on the address of the type_info object. That is unique per
+	// type within a program, but the standard does not promise it;
+	// shared libraries may have their own copy. So, the type is checked,
+	// and on a mismatch, the slow path does a proper lookup.
+	void operator()(std::any const& a) const
+	{
+		std::type_info const& t = a.type();
+		size_t i = m_table[slot(&t)];
+		if(i != none && m_handlers[i].type == &t)
+			m_handlers[i].f(a);
+		else
+			visit_map(a);
+	}
+
+	// Look up the handler in an unordered_map.
+	void visit_map(std::any const& a) const
+	{
+		auto it = m_by_type.find(a.type());
+		call(it == m_by_type.end() ? none : it->second, a);
+	}
+#endif
+
+private:
+	static constexpr size_t none = ~size_t{0};
+
+	struct handler {
+#if HAVE_RTTI
+		std::type_info const* type;
+#endif
+		handler_type f;
+	};
+
+	void call(size_t i, std::any const& a) const
+	{
+		if(i != none)
+			m_handlers[i].f(a);
+		else if(m_otherwise)
+			m_otherwise(a);
+	}
+
+#if HAVE_RTTI
+	size_t slot(std::type_info const* t) const noexcept
+	{
+		return static_cast<size_t>((reinterpret_cast<uintptr_t>(t) * m_seed) >> m_shift);
+	}
+
+	// Find a multiplier for which all registered types get a different
+	// slot. Start with twice as many slots as types, and grow the table
+	// when no multiplier works. Every type has its own type_info, so some
+	// multiplier does the job long before the table gets too large.
+	void build()
+	{
+		unsigned bits = 1;
+		while((size_t{1} << bits) < m_handlers.size() * 2U)
+			bits++;
+
+		for(; bits < 24U; bits++) {
+			m_shift = static_cast<unsigned>(sizeof(uintptr_t) * 8U) - bits;
+			uint64_t x = 0;
+			for(int attempt = 0; attempt < 1000; attempt++) {
+				x += 0x9e3779b97f4a7c15ULL;
+				m_seed = static_cast<uintptr_t>(x | 1U);
+				m_table.assign(size_t{1} << bits, none);
+
+				bool ok = true;
+				for(size_t i = 0; i < m_handlers.size() && ok; i++) {
+					auto& s = m_table[slot(m_handlers[i].type)];
+					ok = s == none;
+					s = i;
+				}
+
+				if(ok)
+					return;
+			}
+		}
+
+		throw std::logic_error{"No perfect hash found"};
+	}
+#endif
+
+	std::vector<handler> m_handlers;
+	std::vector<size_t> m_by_tag;
+	handler_type m_otherwise;
+#if HAVE_RTTI
+	std::unordered_map<std::type_index, size_t> m_by_type;
+	std::vector<size_t> m_table{none};
+	uintptr_t m_seed = 1;
+	unsigned m_shift = sizeof(uintptr_t) * 8U - 1U;
+#endif
+};
+
+
+
+////////////////////////////////////////////
+// Benchmark
+//
+
+// Lots of types.
+template <size_t I>
+struct Song {
+	int year;
+};
+
+// Make a value of type T, and get a number out of it.
+template <typename T>
+struct value_of;
+
+template <>
+struct value_of<int> {
+	static int make(int x) { return x; }
+	static int get(int x) { return x; }
+};
+
+template <>
+struct value_of<char const*> {
+	static char const* make(int /*x*/) { return "esc2020"; }
+	static int get(char const* x) { return x[0]; }
+};
+
+template <>
+struct value_of<std::string> {
+	static std::string make(int x) { return std::string(static_cast<size_t>(x % 8), 'x'); }
+	static int get(std::string const& x) { return static_cast<int>(x.size()); }
+};
+
+template <size_t I>
+struct value_of<Song<I>> {
+	static Song<I> make(int x) { return {x}; }
+	static int get(Song<I> const& x) { return x.year + static_cast<int>(I); }
+};
+
+// What show() does, for any number of types: try them in order.
+template <typename T, typename F>
+static bool try_cast(std::any const& a, F& f)
+{
+	if(auto const* p = std::any_cast<T>(&a)) {
+		f(*p);
+		return true;
+	}
+	return false;
+}
+
+template <typename... T, typename F>
+static void if_chain(std::any const& a, F& f)
+{
+	(try_cast<T>(a, f) || ...);
+}
+
+template <typename... T>
+static int benchmark(char const* name, size_t n)
+{
+	constexpr size_t types = sizeof...(T);
+	using maker = std::any (*)(int);
+	static constexpr std::array<maker, types> make{
+		[](int x) { return std::any{value_of<T>::make(x)}; }...};
+	using tagged_maker = tagged_any (*)(int);
+	static constexpr std::array<tagged_maker, types> make_tagged{
+		[](int x) { return tagged_any{value_of<T>::make(x)}; }...};
+
+	// Random types, so the branch predictor cannot guess.
+	std::vector<std::any> values;
+	std::vector<tagged_any> tagged;
+	values.reserve(n);
+	tagged.reserve(n);
+	uint32_t x = 1;
+	for(size_t i = 0; i < n; i++) {
+		x = x * 1664525U + 1013904223U;
+		auto t = static_cast<size_t>((uint64_t{x} * types) >> 32U);
+		auto v = static_cast<int>(x >> 24U);
+		values.push_back(make[t](v));
+		tagged.push_back(make_tagged[t](v));
+	}
+
+	long sum = 0;
+	auto add = [&sum](auto const& v) { sum += value_of<std::decay_t<decltype(v)>>::get(v); };
+
+	any_visitor visitor;
+	(visitor.on<T>(add), ...);
+
+	std::cout << std::endl << name << ":" << std::endl;
+	std::array<long, 4> sums{};
+
+	bench::measure("if-chain", n, [&] {
+		for(auto const& v : values)
+			if_chain<T...>(v, add);
+		bench::escape(sum);
+	});
+	sums[0] = std::exchange(sum, 0);
+
+#if HAVE_RTTI
+	bench::measure("unordered_map<type_index>", n, [&] {
+		for(auto const& v : values)
+			visitor.visit_map(v);
+		bench::escape(sum);
+	});
+	sums[1] = std::exchange(sum, 0);
+
+	bench::measure("perfect hash", n, [&] {
+		for(auto const& v : values)
+			visitor(v);
+		bench::escape(sum);
+	});
+	sums[2] = std::exchange(sum, 0);
+#endif
+
+	bench::measure("tag", n, [&] {
+		for(auto const& v : tagged)
+			visitor(v);
+		bench::escape(sum);
+	});
+	sums[3] = std::exchange(sum, 0);
+
+#if HAVE_RTTI
+	return sums[0] == sums[1] && sums[0] == sums[2] && sums[0] == sums[3] ? 0 : 1;
+#else
+	return sums[0] == sums[3] ? 0 : 1;
+#endif
+}
+
+template <size_t... I>
+static int benchmark_songs(char const* name, size_t n, std::index_sequence<I...>)
+{
+	return benchmark<Song<I>...>(name, n);
+}
+
+int main(int argc, char** argv)
+{
+	// The show() of 20210517_any, as a visitor.
+	any_visitor show;
+	show.on<int>([](int i) { std::cout << i << " (int)" << std::endl; })
+		.on<char const*>([](char const* s) { std::cout << s << " (char const*)" << std::endl; })
+		.on<std::string>([](std::string const& s) { std::cout << s << " (std::string)" << std::endl; })
+#if HAVE_RTTI
+		.otherwise([](std::any const& a) { std::cout << "(unknown type " << a.type().name() << ")" << std::endl; });
+#else
+		.otherwise([](std::any const& /*a*/) { std::cout << "(unknown type)" << std::endl; });
+#endif
+
+	char Toy[] = "Toy";
+	std::string Duncan{"Arcade"};
+#if HAVE_RTTI
+	std::vector<std::any> songs = {1944, "Amar pelos dois", Toy, Duncan, 2014.0};
+#else
+	// Without RTTI, a std::any cannot tell its type. A tagged_any can.
+	std::vector<tagged_any> songs = {1944, "Amar pelos dois", Toy, Duncan, 2014.0};
+#endif
+	for(auto const& song : songs)
+		show(song);
+
+	// Registering a type again replaces its handler.
+	int last = 0;
+	any_visitor twice;
+	twice.on<int>([&last](int i) { last = i; }).on<int>([&last](int i) { last = -i; });
+	twice(tagged_any{2022});
+	if(last != -2022)
+		return 1;
+
+
+
+	// Try 10000000.
+	size_t n = bench::scale(argc, argv, 100'000);
+
+	int res = 0;
+	res |= benchmark<int, char const*, std::string>("3 types", n);
+	res |= benchmark_songs("10 types", n, std::make_index_sequence<10>{});
+	res |= benchmark_songs("50 types", n, std::make_index_sequence<50>{});
+
+	// The if-chain gets slower with every type, the others do not. The
+	// unordered_map hashes the type name on some platforms, which is not
+	// free either. The perfect hash is a multiplication, a shift, and a
+	// pointer comparison; the tag is an array index. All of them still
+	// call a std::function, which does an any_cast, which checks the type
+	// once more. That is the price of safety.
+	return res;
+}
+
+/*
+ * Further reading:
+ *
+ * https://en.cppreference.com/w/cpp/types/type_index
+ * https://en.wikipedia.org/wiki/Perfect_hash_function
+ * https://en.wikipedia.org/wiki/Hash_function#Multiplicative_hashing
+ *
+ * See also 20210517_any and 20211115_enum_names.
+ */
@@ -0,0 +1,400 @@
+﻿/*
+ * Small buffer optimization
+ *
+ * 20210517_any puts a lambda, some ints, strings, and a std::function in a
+ * std::any. std::any may keep small objects inside itself, instead of
+ * allocating them on the heap, but how small is up to the implementation.
+ * libstdc++ only stores objects that fit in one pointer. A std::string, a
+ * std::function, or any struct of more than 8 bytes goes to the heap. And
+ * every copy of the std::any allocates again.
+ *
+ * If you know what you are going to store, you can do better: make the
+ * buffer as large as your common types. Let's write our own any, with the
+ * buffer size as template parameter. It also does not need RTTI: a table of
+ * function pointers per type tells both how to copy, move and destroy the
+ * contents, and which type it is.
+ *
+ * Scroll down to main() and follow the program flow.
+ */
+
+// These includes are just for this example.
+#include "allocations.h"
+#include "bench.h"
+
+#include <any>
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+
+////////////////////////////////////////////
+// basic_any
+//
+
+// An any that stores objects of at most BufferSize bytes and alignment Align
+// inline, and others on the heap. When Copyable is false, the any is
+// move-only, and so may be the objects in it.
+template <size_t BufferSize = 4 * sizeof(void*), size_t Align = alignof(std::max_align_t), bool Copyable = true>
+class basic_any {
+	static_assert(BufferSize >= sizeof(void*), "The buffer must hold at least a pointer");
+
+	union storage {
+		alignas(Align) unsigned char buffer[BufferSize];
+		void* heap;
+	};
+
+	using copy_fn = void (*)(storage const& from, storage& to);
+
+	// The manual vtable. Its address identifies the type.
+	struct vtable {
+		void (*destroy)(storage& s) noexcept;
+		copy_fn copy;
+		void (*move)(storage& from, storage& to) noexcept;
+	};
+
+	// A move-only any has no copy constructor: it takes this instead.
+	struct disabled {};
+	using copy_arg = std::conditional_t<Copyable, basic_any, disabled>;
+
+	// Moving an inline object must not throw, or moving the any could
+	// throw. Objects that may throw on a move go to the heap; moving a
+	// pointer never throws.
+	template <typename T>
+	static constexpr bool is_inline = sizeof(T) <= BufferSize && alignof(T) <= Align &&
+		std::is_nothrow_move_constructible_v<T>;
+
+	template <typename T>
+	static T* inline_ptr(storage& s) noexcept
+	{
+		return std::launder(reinterpret_cast<T*>(&s.buffer[0]));
+	}
+
+	template <typename T>
+	static T const* inline_ptr(storage const& s) noexcept
+	{
+		return std::launder(reinterpret_cast<T const*>(&s.buffer[0]));
+	}
+
+	template <typename T>
+	static void destroy(storage& s) noexcept
+	{
+		if constexpr(is_inline<T>)
+			inline_ptr<T>(s)->~T();
+		else
+			delete static_cast<T*>(s.heap);
+	}
+
+	template <typename T>
+	static void copy(storage const& from, storage& to)
+	{
+		if constexpr(is_inline<T>)
+			::new(&to.buffer[0]) T(*inline_ptr<T>(from));
+		else
+			to.heap = new T(*static_cast<T const*>(from.heap));
+	}
+
+	template <typename T>
+	static void move(storage& from, storage& to) noexcept
+	{
+		if constexpr(is_inline<T>) {
+			::new(&to.buffer[0]) T(std::move(*inline_ptr<T>(from)));
+			inline_ptr<T>(from)->~T();
+		} else {
+			to.heap = from.heap;
+		}
+	}
+
+	// Do not even instantiate copy<T>() for a move-only any, as T may not
+	// be copyable.
+	template <typename T>
+	static constexpr copy_fn copier() noexcept
+	{
+		if constexpr(Copyable)
+			return &copy<T>;
+		else
+			return nullptr;
+	}
+
+	template <typename T>
+	static constexpr vtable vtable_for{&destroy<T>, copier<T>(), &move<T>};
+
+public:
+	static constexpr size_t buffer_size = BufferSize;
+
+	template <typename T>
+	static constexpr bool fits = is_inline<std::decay_t<T>>;
+
+	basic_any() noexcept = default;
+
+	template <typename T, typename D = std::decay_t<T>,
+		std::enable_if_t<!std::is_same_v<D, basic_any>, int> = 0>
+	basic_any(T&& value)
+	{
+		emplace<D>(std::forward<T>(value));
+	}
+
+	basic_any(copy_arg const& other)
+	{
+		if(other.m_vtable) {
+			other.m_vtable->copy(other.m_storage, m_storage);
+			m_vtable = other.m_vtable;
+		}
+	}
+
+	basic_any(basic_any&& other) noexcept
+	{
+		if(other.m_vtable) {
+			other.m_vtable->move(other.m_storage, m_storage);
+			m_vtable = std::exchange(other.m_vtable, nullptr);
+		}
+	}
+
+	basic_any& operator=(copy_arg const& other)
+	{
+		// Copy first; if that throws, *this is unchanged.
+		if(this != &other)
+			*this = basic_any{other};
+		return *this;
+	}
+
+	basic_any& operator=(basic_any&& other) noexcept
+	{
+		if(this != &other) {
+			reset();
+			if(other.m_vtable) {
+				other.m_vtable->move(other.m_storage, m_storage);
+				m_vtable = std::exchange(other.m_vtable, nullptr);
+			}
+		}
+		return *this;
+	}
+
+	~basic_any()
+	{
+		reset();
+	}
+
+	template <typename T, typename... Args>
+	T& emplace(Args&&... args)
+	{
+		static_assert(Copyable ? std::is_copy_constructible_v<T> : std::is_move_constructible_v<T>,
+			"Type cannot be stored in this any");
+
+		reset();
+		T* p = nullptr;
+		if constexpr(is_inline<T>)
+			p = ::new(&m_storage.buffer[0]) T(std::forward<Args>(args)...);
+		else
+			m_storage.heap = p = new T(std::forward<Args>(args)...);
+		m_vtable = &vtable_for<T>;
+		return *p;
+	}
+
+	void reset() noexcept
+	{
+		if(m_vtable) {
+			m_vtable->destroy(m_storage);
+			m_vtable = nullptr;
+		}
+	}
+
+	bool has_value() const noexcept { return m_vtable != nullptr; }
+
+	// Check the type by comparing vtable pointers. No RTTI needed.
+	template <typename T>
+	bool holds() const noexcept
+	{
+		return m_vtable == &vtable_for<T>;
+	}
+
+	template <typename T>
+	T* get() noexcept
+	{
+		if(!holds<T>())
+			return nullptr;
+		if constexpr(is_inline<T>)
+			return inline_ptr<T>(m_storage);
+		else
+			return static_cast<T*>(m_storage.heap);
+	}
+
+	template <typename T>
+	T const* get() const noexcept
+	{
+		return const_cast<basic_any*>(this)->template get<T>();
+	}
+
+private:
+	storage m_storage;
+	vtable const* m_vtable = nullptr;
+};
+
+template <size_t BufferSize = 4 * sizeof(void*), size_t Align = alignof(std::max_align_t)>
+using unique_any = basic_any<BufferSize, Align, false>;
+
+// Like std::any_cast: a pointer for a pointer, or throw for a reference.
+template <typename T, size_t S, size_t A, bool C>
+T const* any_cast(basic_any<S, A, C> const* a) noexcept
+{
+	return a ? a->template get<T>() : nullptr;
+}
+
+template <typename T, size_t S, size_t A, bool C>
+T* any_cast(basic_any<S, A, C>* a) noexcept
+{
+	return a ? a->template get<T>() : nullptr;
+}
+
+template <typename T, size_t S, size_t A, bool C>
+T const& any_cast(basic_any<S, A, C> const& a)
+{
+	if(auto const* p = a.template get<T>())
+		return *p;
+	throw std::bad_any_cast{};
+}
+
+using small_any = basic_any<>;
+
+static_assert(small_any::fits<int>);
+static_assert(small_any::fits<char const*>);
+static_assert(!small_any::fits<std::array<char, 64>>);
+static_assert(std::is_copy_constructible_v<small_any>);
+static_assert(!std::is_copy_constructible_v<unique_any<>>);
+static_assert(std::is_nothrow_move_constructible_v<small_any>);
+
+
+
+////////////////////////////////////////////
+// Benchmark
+//
+
+template <size_t N>
+struct Payload {
+	std::array<char, N> data;
+};
+
+template <typename Any, typename T>
+static T const* cast(Any const& a)
+{
+	if constexpr(std::is_same_v<Any, std::any>)
+		return std::any_cast<T>(&a);
+	else
+		return any_cast<T>(&a);
+}
+
+template <typename Any, size_t N>
+static void benchmark(char const* name, size_t n)
+{
+	std::vector<Any> v;
+	v.reserve(n);
+
+	size_t before = bench::allocations();
+	bench::measure("construct", n, [&] {
+		for(size_t i = 0; i < n; i++)
+			v.emplace_back(Payload<N>{{static_cast<char>(i)}});
+	});
+	size_t constructs = bench::allocations() - before;
+
+	before = bench::allocations();
+	std::vector<Any> copies;
+	bench::measure("copy", n, [&] {
+		copies = v;
+	});
+	size_t copy_allocations = bench::allocations() - before - 1U;
+
+	long sum = 0;
+	bench::measure("any_cast", n, [&] {
+		for(auto const& a : copies)
+			sum += cast<Any, Payload<N>>(a)->data[0];
+		bench::escape(sum);
+	});
+
+	std::cout << "  " << name << ": " << static_cast<double>(constructs) / static_cast<double>(n)
+		<< " allocations per construction, " << static_cast<double>(copy_allocations) / static_cast<double>(n)
+		<< " per copy" << std::endl;
+}
+
+template <size_t N>
+static void benchmark(size_t n)
+{
+	std::cout << std::endl << N << " byte payload, std::any:" << std::endl;
+	benchmark<std::any, N>("std::any", n);
+	// A buffer of exactly the payload, aligned like a pointer.
+	std::cout << N << " byte payload, basic_any<" << N << ">:" << std::endl;
+	benchmark<basic_any<N, alignof(void*)>, N>("basic_any", n);
+}
+
+int main(int argc, char** argv)
+{
+	// The songs of 20210517_any.
+	auto lordi = [](){ return "Hard Rock Hallelujah"; };
+	char Toy[] = "Toy";
+	std::string Duncan{"Arcade"};
+	std::vector<small_any> songs = {lordi, 1944, "Amar pelos dois", Toy, Duncan};
+
+	for(auto const& song : songs) {
+		if(auto const* i = any_cast<int>(&song))
+			std::cout << *i << " (int)" << std::endl;
+		else if(auto const* s = any_cast<std::string>(&song))
+			std::cout << *s << " (std::string)" << std::endl;
+		else if(auto const* c = any_cast<char const*>(&song))
+			std::cout << *c << " (char const*)" << std::endl;
+		else if(auto const* l = any_cast<decltype(lordi)>(&song))
+			std::cout << (*l)() << " (lambda)" << std::endl;
+	}
+
+	// The std::function of esc2006 takes 32 bytes with libstdc++, so it
+	// fits, and copying it does not allocate. Other standard libraries
+	// have larger ones.
+	small_any esc2006 = std::function<char const*()>{lordi};
+	std::cout << "sizeof(std::function) = " << sizeof(std::function<char const*()>)
+		<< ", fits: " << small_any::fits<std::function<char const*()>> << std::endl;
+	size_t before = bench::allocations();
+	small_any copy = esc2006;
+	std::cout << "Copying it: " << bench::allocations() - before << " allocations" << std::endl;
+	std::cout << any_cast<std::function<char const*()>>(copy)() << std::endl;
+
+	// A move-only any takes move-only types, like std::unique_ptr.
+	unique_any<> u = std::make_unique<int>(2021);
+	unique_any<> u2 = std::move(u);
+	if(u.has_value() || **any_cast<std::unique_ptr<int>>(&u2) != 2021)
+		return 1;
+
+	try {
+		any_cast<int>(copy);
+		return 1;
+	} catch(std::bad_any_cast const&) {
+	}
+
+
+
+	size_t n = bench::scale(argc, argv, 100'000);
+	std::cout << std::endl << n << " values" << std::endl;
+	benchmark<8>(n);
+	benchmark<16>(n);
+	benchmark<32>(n);
+	benchmark<64>(n);
+
+	// std::any allocates for everything above 8 bytes, at construction
+	// and at every copy. basic_any never does, but it is as large as its
+	// buffer, even when holding a char. A vector of large anys has to
+	// move more memory around, which may cost more than the allocations
+	// it saves. Pick the buffer size for the types you actually store.
+}
+
+/*
+ * Further reading:
+ *
+ * https://en.cppreference.com/w/cpp/utility/any
+ * https://en.cppreference.com/w/cpp/utility/launder
+ *
+ * See also 20210517_any and 20220124_any_visitor.
+ */
@@ -0,0 +1,335 @@
+﻿/*
+ * Polymorphic collections
+ *
+ * The songs of 20210517_any are in a std::vector<std::any>. Every element is
+ * a separate object, possibly on the heap, and every visit starts with asking
+ * "what are you?". The classic object-oriented alternative, a
+ * std::vector<std::unique_ptr<Base>>, is not better: a pointer to follow, and
+ * a virtual call, per element. The CPU cannot predict which function comes
+ * next, and the compiler cannot inline anything.
+ *
+ * But you rarely care in which order different types are visited. So, store
+ * all objects of the same type together, in a std::vector of their own. A
+ * loop over one such segment knows the type, so it is a plain loop over an
+ * array, without any dispatch. Only when switching segments, something has
+ * to be looked up. Boost.PolyCollection works like this.
+ *
+ * Scroll down to main() and follow the program flow.
+ */
+
+// These includes are just for this example.
+#include "bench.h"
+
+#include <algorithm>
+#include <any>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <typeindex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+
+////////////////////////////////////////////
+// The collection
+//
+
+class poly_collection {
+public:
+	// Keeping track of the insertion order costs memory and speed, so it
+	// is only done when asked for.
+	enum class order { segment, insertion };
+
+	explicit poly_collection(order o = order::segment) noexcept
+		: m_keep_order{o == order::insertion}
+	{}
+
+	// Add a value to the segment of its type. Any copyable type will do.
+	template <typename T>
+	std::decay_t<T>& insert(T&& value)
+	{
+		auto& s = segment_of<std::decay_t<T>>();
+		if(m_keep_order)
+			m_order.emplace_back(&s, s.items.size());
+		return s.items.emplace_back(std::forward<T>(value));
+	}
+
+	size_t size() const noexcept
+	{
+		size_t n = 0;
+		for(auto const& s : m_segments)
+			n += s->size();
+		return n;
+	}
+
+	size_t segments() const noexcept { return m_segments.size(); }
+
+	// All values of type T.
+	template <typename T>
+	std::vector<T> const& segment() const
+	{
+		static std::vector<T> const empty;
+		auto const* s = find<T>();
+		return s ? s->items : empty;
+	}
+
+	// Call f for every value, segment by segment. The segments of Ts are
+	// plain loops with a known type, which the compiler can inline. All
+	// other values are passed as a std::any, if f accepts that. Otherwise,
+	// they are skipped.
+	template <typename... Ts, typename F>
+	void for_each(F&& f) const
+	{
+		std::array<segment_base const*, sizeof...(Ts)> known{find<Ts>()...};
+		(for_each_in<Ts>(find<Ts>(), f), ...);
+
+		if constexpr(std::is_invocable_v<F&, std::any const&>) {
+			std::function<void(std::any const&)> g{std::ref(f)};
+			for(auto const& s : m_segments)
+				if(std::find(known.begin(), known.end(), s.get()) == known.end())
+					s->for_each_any(g);
+		}
+	}
+
+	// Call f for every value, in the order they were inserted. Now, every
+	// value needs a lookup of its segment, and values of the same type
+	// are not next to each other anymore.
+	template <typename... Ts, typename F>
+	void for_each_in_order(F&& f) const
+	{
+		if(!m_keep_order)
+			throw std::logic_error{"Insertion order not kept"};
+
+		std::array<segment_base const*, sizeof...(Ts)> known{find<Ts>()...};
+		for(auto [s, i] : m_order)
+			visit<Ts...>(known, s, i, f, std::index_sequence_for<Ts...>{});
+	}
+
+private:
+	struct segment_base {
+		virtual ~segment_base() = default;
+		virtual size_t size() const noexcept = 0;
+		virtual void any_at(size_t i, std::function<void(std::any const&)> const& f) const = 0;
+		virtual void for_each_any(std::function<void(std::any const&)> const& f) const = 0;
+	};
+
+	template <typename T>
+	struct typed_segment final : segment_base {
+		std::vector<T> items;
+
+		size_t size() const noexcept final { return items.size(); }
+
+		void any_at(size_t i, std::function<void(std::any const&)> const& f) const final
+		{
+			f(std::any{items[i]});
+		}
+
+		void for_each_any(std::function<void(std::any const&)> const& f) const final
+		{
+			for(auto const& x : items)
+				f(std::any{x});
+		}
+	};
+
+	template <typename T>
+	typed_segment<T> const* find() const noexcept
+	{
+		auto it = m_index.find(typeid(T));
+		return it == m_index.end() ? nullptr : static_cast<typed_segment<T> const*>(it->second);
+	}
+
+	template <typename T>
+	typed_segment<T>& segment_of()
+	{
+		auto& s = m_index[typeid(T)];
+		if(!s) {
+			m_segments.push_back(std::make_unique<typed_segment<T>>());
+			s = m_segments.back().get();
+		}
+		return static_cast<typed_segment<T>&>(*s);
+	}
+
+	template <typename T, typename F>
+	static void for_each_in(typed_segment<T> const* s, F& f)
+	{
+		if(s)
+			for(auto const& x : s->items)
+				f(x);
+	}
+
+	template <typename... Ts, typename F, size_t... I>
+	static void visit(std::array<segment_base const*, sizeof...(Ts)> const& known,
+		segment_base const* s, size_t i, F& f, std::index_sequence<I...>)
+	{
+		bool done = ((s == known[I] ? (f(static_cast<typed_segment<Ts> const*>(s)->items[i]), true) : false) || ...);
+
+		if constexpr(std::is_invocable_v<F&, std::any const&>)
+			if(!done)
+				s->any_at(i, std::ref(f));
+	}
+
+	bool m_keep_order;
+	std::vector<std::unique_ptr<segment_base>> m_segments;
+	std::unordered_map<std::type_index, segment_base*> m_index;
+	std::vector<std::pair<segment_base const*, size_t>> m_order;
+};
+
+
+
+////////////////////////////////////////////
+// Benchmark
+//
+
+// Songs, with a classic base class.
+struct Song {
+	virtual ~Song() = default;
+	virtual int score() const = 0;
+};
+
+struct Winner final : Song {
+	Winner(int y, char const* t) : year{y}, title{t} {}
+	int score() const final { return year; }
+	int year;
+	char const* title;
+};
+
+struct Entry final : Song {
+	Entry(int y, int p) : year{y}, points{p} {}
+	int score() const final { return points; }
+	int year;
+	int points;
+};
+
+struct Cover final : Song {
+	Cover(int y, int v) : year{y}, views{v} {}
+	int score() const final { return views / 1000; }
+	int year;
+	int views;
+};
+
+int main(int argc, char** argv)
+{
+	// The songs of 20210517_any.
+	auto lordi = [](){ return "Hard Rock Hallelujah"; };
+	char Toy[] = "Toy";
+	std::string Duncan{"Arcade"};
+
+	poly_collection songs{poly_collection::order::insertion};
+	songs.insert(lordi);
+	songs.insert(1944);
+	songs.insert("Amar pelos dois");
+	songs.insert(Toy);
+	songs.insert(Duncan);
+	songs.insert(2014);
+
+	std::cout << songs.size() << " songs in " << songs.segments() << " segments" << std::endl;
+
+	// Overloads for the types we know, and std::any for the rest.
+	struct {
+		void operator()(int i) const { std::cout << "  " << i << " (int)" << std::endl; }
+		void operator()(char const* s) const { std::cout << "  " << s << " (char const*)" << std::endl; }
+		void operator()(std::string const& s) const { std::cout << "  " << s << " (std::string)" << std::endl; }
+		void operator()(std::any const& a) const { std::cout << "  (unknown type " << a.type().name() << ")" << std::endl; }
+	} show;
+
+	// Toy decays to a char*; a string literal to a char const*.
+	std::cout << "By segment:" << std::endl;
+	songs.for_each<int, char const*, std::string>(show);
+	std::cout << "In insertion order:" << std::endl;
+	songs.for_each_in_order<int, char const*, char*, std::string>(show);
+
+
+
+	size_t n = bench::scale(argc, argv, 100'000);
+	std::vector<std::unique_ptr<Song>> pointers;
+	std::vector<std::any> anys;
+	poly_collection segments;
+	poly_collection ordered{poly_collection::order::insertion};
+
+	uint32_t x = 1;
+	for(size_t i = 0; i < n; i++) {
+		x = x * 1664525U + 1013904223U;
+		auto v = static_cast<int>(x >> 16U);
+		switch(x >> 30U) {
+		case 0:
+		case 1:
+			pointers.push_back(std::make_unique<Winner>(v, "Arcade"));
+			anys.emplace_back(Winner{v, "Arcade"});
+			segments.insert(Winner{v, "Arcade"});
+			ordered.insert(Winner{v, "Arcade"});
+			break;
+		case 2:
+			pointers.push_back(std::make_unique<Entry>(v, v % 12));
+			anys.emplace_back(Entry{v, v % 12});
+			segments.insert(Entry{v, v % 12});
+			ordered.insert(Entry{v, v % 12});
+			break;
+		default:
+			pointers.push_back(std::make_unique<Cover>(v, v * 3));
+			anys.emplace_back(Cover{v, v * 3});
+			segments.insert(Cover{v, v * 3});
+			ordered.insert(Cover{v, v * 3});
+		}
+	}
+
+	std::cout << std::endl << n << " songs, sum of scores:" << std::endl;
+	std::array<long, 4> sums{};
+
+	bench::measure("vector<unique_ptr<Song>>", n, [&] {
+		for(auto const& p : pointers)
+			sums[0] += p->score();
+		bench::escape(sums);
+	});
+
+	bench::measure("vector<any>", n, [&] {
+		for(auto const& a : anys) {
+			if(auto const* w = std::any_cast<Winner>(&a))
+				sums[1] += w->score();
+			else if(auto const* e = std::any_cast<Entry>(&a))
+				sums[1] += e->score();
+			else if(auto const* c = std::any_cast<Cover>(&a))
+				sums[1] += c->score();
+		}
+		bench::escape(sums);
+	});
+
+	// The types are final, so even the virtual score() is called directly.
+	// Note the return type: without it, checking whether the lambda takes
+	// a std::any would compile its body for a std::any, which fails.
+	bench::measure("poly_collection", n, [&] {
+		segments.for_each<Winner, Entry, Cover>(
+			[&](auto const& s) -> decltype(void(s.score())) { sums[2] += s.score(); });
+		bench::escape(sums);
+	});
+
+	bench::measure("poly_collection, in order", n, [&] {
+		ordered.for_each_in_order<Winner, Entry, Cover>(
+			[&](auto const& s) -> decltype(void(s.score())) { sums[3] += s.score(); });
+		bench::escape(sums);
+	});
+
+	if(sums[0] != sums[1] || sums[0] != sums[2] || sums[0] != sums[3])
+		return 1;
+
+	// Per segment, there is no dispatch at all: the loops are as fast as a
+	// loop over a std::vector<Winner>. In insertion order, every value
+	// needs a few comparisons to find its type again, but at least the
+	// values are stored in arrays, not scattered over the heap.
+}
+
+/*
+ * Further reading:
+ *
+ * https://www.boost.org/doc/libs/release/doc/html/poly_collection.html
+ * https://bannalia.blogspot.com/2014/05/fast-polymorphic-collections.html
+ *
+ * See also 20210517_any, 20220124_any_visitor and 20220131_small_any.
+ */
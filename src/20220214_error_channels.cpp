@@ -0,0 +1,290 @@
+﻿/*
+ * Error channels
+ *
+ * 20210524_optional shows nine ways for a function to say "I have nothing for
+ * you": an output argument, a std::unique_ptr, a std::pair, a std::tuple, a
+ * std::variant, a std::any, an exception, and std::optional, twice. It argues
+ * that std::optional expresses the intention best. But what does each of them
+ * cost?
+ *
+ * That depends on how often there is nothing. An exception is free when it is
+ * not thrown, and very expensive when it is. A std::unique_ptr allocates on
+ * success. And it depends on what is returned: a short std::string fits in
+ * the string itself, a long one is allocated anyway. So, let's measure all
+ * channels, with success ratios from 0% to 100%, for a short and a long
+ * message: time per call, heap allocations per call, and the size of the
+ * machine code.
+ *
+ * Scroll down to main() and follow the program flow.
+ */
+
+// These includes are just for this example.
+#include "allocations.h"
+#include "bench.h"
+
+#include <any>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <variant>
+#include <vector>
+
+
+
+////////////////////////////////////////////
+// The channels
+//
+
+// The functions of 20210524_optional. Instead of tossing a coin, the caller
+// decides whether there is a result, and what the message is.
+static bool troll0(std::string& x, bool ok, char const* msg)
+{
+	if(!ok)
+		return false;
+
+	x = msg;
+	return true;
+}
+
+static std::unique_ptr<std::string> troll1(bool ok, char const* msg)
+{
+	return ok ? std::make_unique<std::string>(msg) : nullptr;
+}
+
+static std::pair<std::string, bool> troll2(bool ok, char const* msg)
+{
+	return ok ? std::make_pair(std::string{msg}, true) : std::make_pair(std::string{}, false);
+}
+
+static std::tuple<std::string, bool> troll3(bool ok, char const* msg)
+{
+	return ok ? std::make_tuple(std::string{msg}, true) : std::make_tuple(std::string{}, false);
+}
+
+static std::variant<std::monostate, std::string> troll4(bool ok, char const* msg)
+{
+	std::variant<std::monostate, std::string> res;
+	return ok ? res = std::string{msg} : res;
+}
+
+static std::any troll5(bool ok, char const* msg)
+{
+	return ok ? std::any{std::string{msg}} : std::any{};
+}
+
+static std::string troll6(bool ok, char const* msg)
+{
+	if(ok)
+		return msg;
+
+	throw "Truth bomb";
+}
+
+static std::optional<std::string> elf0(bool ok, char const* msg)
+{
+	std::optional<std::string> res;
+
+	if(ok)
+		res = msg;
+
+	return res;
+}
+
+static std::optional<std::string> elf1(bool ok, char const* msg)
+{
+	if(ok)
+		return msg;
+
+	return std::nullopt;
+}
+
+// For every channel, a loop that calls it n times, like main() of
+// 20210524_optional does once. The loops are called via a function pointer,
+// so they are compiled as separate functions, with the channel inlined. That
+// is what the code size is measured of.
+using runner = size_t (*)(char const* ok, size_t n, char const* msg);
+
+static size_t run_troll0(char const* ok, size_t n, char const* msg)
+{
+	size_t sum = 0;
+	for(size_t i = 0; i < n; i++)
+		if(std::string x; troll0(x, ok[i] != 0, msg))
+			sum += x.size();
+	return sum;
+}
+
+static size_t run_troll1(char const* ok, size_t n, char const* msg)
+{
+	size_t sum = 0;
+	for(size_t i = 0; i < n; i++)
+		if(auto x = troll1(ok[i] != 0, msg))
+			sum += x->size();
+	return sum;
+}
+
+static size_t run_troll2(char const* ok, size_t n, char const* msg)
+{
+	size_t sum = 0;
+	for(size_t i = 0; i < n; i++)
+		if(auto x = troll2(ok[i] != 0, msg); x.second)
+			sum += x.first.size();
+	return sum;
+}
+
+static size_t run_troll3(char const* ok, size_t n, char const* msg)
+{
+	size_t sum = 0;
+	for(size_t i = 0; i < n; i++)
+		if(auto x = troll3(ok[i] != 0, msg); std::get<bool>(x))
+			sum += std::get<std::string>(x).size();
+	return sum;
+}
+
+static size_t run_troll4(char const* ok, size_t n, char const* msg)
+{
+	size_t sum = 0;
+	for(size_t i = 0; i < n; i++)
+		if(auto x = troll4(ok[i] != 0, msg); auto* p = std::get_if<std::string>(&x))
+			sum += p->size();
+	return sum;
+}
+
+static size_t run_troll5(char const* ok, size_t n, char const* msg)
+{
+	size_t sum = 0;
+	for(size_t i = 0; i < n; i++)
+		if(auto x = troll5(ok[i] != 0, msg); auto* p = std::any_cast<std::string>(&x))
+			sum += p->size();
+	return sum;
+}
+
+static size_t run_troll6(char const* ok, size_t n, char const* msg)
+{
+	size_t sum = 0;
+	for(size_t i = 0; i < n; i++) {
+		try {
+			sum += troll6(ok[i] != 0, msg).size();
+		} catch(char const*) {
+		}
+	}
+	return sum;
+}
+
+static size_t run_elf0(char const* ok, size_t n, char const* msg)
+{
+	size_t sum = 0;
+	for(size_t i = 0; i < n; i++)
+		if(auto x = elf0(ok[i] != 0, msg); x.has_value())
+			sum += x.value().size();
+	return sum;
+}
+
+static size_t run_elf1(char const* ok, size_t n, char const* msg)
+{
+	size_t sum = 0;
+	for(size_t i = 0; i < n; i++)
+		if(auto x = elf1(ok[i] != 0, msg))
+			sum += x->size();
+	return sum;
+}
+
+struct channel {
+	char const* name;
+	char const* symbol;
+	runner run;
+};
+
+static std::array<channel, 9> const channels{{
+	{"arg", "run_troll0", &run_troll0},
+	{"unique_ptr", "run_troll1", &run_troll1},
+	{"pair", "run_troll2", &run_troll2},
+	{"tuple", "run_troll3", &run_troll3},
+	{"variant", "run_troll4", &run_troll4},
+	{"any", "run_troll5", &run_troll5},
+	{"exceptions", "run_troll6", &run_troll6},
+	{"optional 1", "run_elf0", &run_elf0},
+	{"optional 2", "run_elf1", &run_elf1},
+}};
+
+
+
+////////////////////////////////////////////
+// Benchmark
+//
+
+static void benchmark(char const* payload, char const* msg, size_t n)
+{
+	std::cout << std::endl << payload << " message (" << std::string_view{msg}.size() << " chars), "
+		<< n << " calls per cell" << std::endl;
+
+	std::cout << std::left << std::setw(12) << "success:" << std::right;
+	for(auto r : bench::ratios)
+		std::cout << std::setw(8) << r << "%" << std::setw(10) << "";
+	std::cout << std::endl;
+
+	std::array<std::vector<char>, bench::ratios.size()> ok;
+	for(size_t r = 0; r < bench::ratios.size(); r++)
+		ok[r] = bench::pattern(n, bench::ratios[r]);
+
+	std::cout << std::fixed << std::setprecision(2);
+	for(auto const& c : channels) {
+		std::cout << std::left << std::setw(12) << c.name << std::right;
+		for(size_t r = 0; r < bench::ratios.size(); r++) {
+			auto const* o = ok[r].data();
+			size_t before = bench::allocations();
+			size_t sum = 0;
+			perf::sample s = bench::count([&] { sum = c.run(o, n, msg); });
+			bench::escape(sum);
+			auto nn = static_cast<double>(n);
+			std::cout << std::setw(8) << s.seconds * 1e9 / nn << " ns "
+				<< std::setw(4) << static_cast<double>(bench::allocations() - before) / nn << " a ";
+			bench::counters(s, n);
+		}
+		std::cout << std::endl;
+	}
+	std::cout << std::defaultfloat << std::setprecision(6);
+}
+
+int main(int argc, char** argv)
+{
+	// The machine code of every channel, including the loop around it. Only
+	// meaningful in a Release build.
+	std::cout << "Code size (bytes):" << std::endl;
+	for(auto const& c : channels)
+		std::cout << "  " << std::left << std::setw(12) << c.name << std::right
+			<< std::setw(6) << bench::code_size(c.symbol) << std::endl;
+
+	// Try 1000000.
+	size_t n = bench::scale(argc, argv, 10'000);
+
+	benchmark("Short", "5G", n);
+	benchmark("Long",
+		"COVID-19 is just like the common flu (and I heard some "
+		"self-claimed expert saying this, so I believe it immediately)", n);
+
+	// ns is the time per call, a is the number of allocations per call.
+	//
+	// With short messages, nothing allocates, except unique_ptr and any
+	// on success. With long messages, the string allocates anyway, and
+	// the differences become small. Except for exceptions: as soon as
+	// there are failures, they are by far the slowest. std::optional is
+	// as cheap as a pair, and clearer. Choose it, unless failures are
+	// truly exceptional.
+}
+
+/*
+ * Further reading:
+ *
+ * https://en.cppreference.com/w/cpp/utility/optional
+ * https://www.open-std.org/jtc1/sc22/wg21/docs/papers/2018/p0709r0.pdf
+ *
+ * See also 20210524_optional and 20220131_small_any.
+ */
@@ -0,0 +1,622 @@
+﻿/*
+ * expected
+ *
+ * std::optional of 20210524_optional tells you that there is no value, but
+ * not why. An exception tells you why, but 20220214_error_channels shows that
+ * throwing one is two orders of magnitude slower than returning. C++23 has
+ * std::expected<T, E>: either a value T, or an error E, in the object itself,
+ * without any allocation. Our compilers do not have it yet, but the
+ * important parts are easy to write in C++17.
+ *
+ * Checking after every step of a computation quickly becomes a wall of
+ * if-statements. So, expected has and_then(), transform() and or_else(),
+ * which do the checking for you, and pass the error along the pipeline.
+ *
+ * Scroll down to main() and follow the program flow.
+ */
+
+// These includes are just for this example.
+#include "bench.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+
+////////////////////////////////////////////
+// unexpected
+//
+
+template <typename T>
+using remove_cvref_t = std::remove_cv_t<std::remove_reference_t<T>>;
+
+// The error, wrapped, such that expected knows it is not a value.
+template <typename E>
+class unexpected {
+public:
+	constexpr explicit unexpected(E const& e) : m_error{e} {}
+	constexpr explicit unexpected(E&& e) : m_error{std::move(e)} {}
+
+	constexpr E const& error() const& noexcept { return m_error; }
+	constexpr E&& error() && noexcept { return std::move(m_error); }
+
+private:
+	E m_error;
+};
+
+// unexpected{"Truth bomb"} is an unexpected<char const*>.
+template <typename E>
+unexpected(E) -> unexpected<E>;
+
+template <typename T>
+struct is_unexpected : std::false_type {};
+
+template <typename E>
+struct is_unexpected<unexpected<E>> : std::true_type {};
+
+// Construct an expected with an error in place.
+struct unexpect_t {
+	explicit unexpect_t() = default;
+};
+
+inline constexpr unexpect_t unexpect{};
+
+// Thrown by value() when there is an error instead.
+template <typename E>
+class bad_expected_access : public std::exception {
+public:
+	explicit bad_expected_access(E e) : m_error{std::move(e)} {}
+	char const* what() const noexcept override { return "bad expected access"; }
+	E const& error() const noexcept { return m_error; }
+
+private:
+	E m_error;
+};
+
+
+
+////////////////////////////////////////////
+// Storage
+//
+
+// A union of T and E, and which one is alive. When both T and E are
+// trivially copyable, the union is as well, and so is the expected. Then it
+// is returned in registers, and copied with a memcpy.
+template <typename T, typename E,
+	bool = std::is_trivially_copyable_v<T> && std::is_trivially_copyable_v<E>>
+class expected_storage {
+public:
+	template <typename... A>
+	constexpr explicit expected_storage(std::in_place_t, A&&... a)
+		: m_value(std::forward<A>(a)...)
+		, m_has_value{true}
+	{}
+
+	template <typename... A>
+	constexpr explicit expected_storage(unexpect_t, A&&... a)
+		: m_error(std::forward<A>(a)...)
+		, m_has_value{false}
+	{}
+
+protected:
+	union {
+		T m_value;
+		E m_error;
+	};
+	bool m_has_value;
+};
+
+// Otherwise, copying, moving and destroying have to look at which one is
+// alive.
+template <typename T, typename E>
+class expected_storage<T, E, false> {
+public:
+	template <typename... A>
+	explicit expected_storage(std::in_place_t, A&&... a)
+		: m_value(std::forward<A>(a)...)
+		, m_has_value{true}
+	{}
+
+	template <typename... A>
+	explicit expected_storage(unexpect_t, A&&... a)
+		: m_error(std::forward<A>(a)...)
+		, m_has_value{false}
+	{}
+
+	expected_storage(expected_storage const& other)
+		: m_has_value{other.m_has_value}
+	{
+		if(m_has_value)
+			new(&m_value) T(other.m_value);
+		else
+			new(&m_error) E(other.m_error);
+	}
+
+	expected_storage(expected_storage&& other) noexcept
+		: m_has_value{other.m_has_value}
+	{
+		if(m_has_value)
+			new(&m_value) T(std::move(other.m_value));
+		else
+			new(&m_error) E(std::move(other.m_error));
+	}
+
+	// Copy first, then destroy and move. Moving does not throw, so when
+	// copying throws, *this is left untouched.
+	expected_storage& operator=(expected_storage other) noexcept
+	{
+		destroy();
+		m_has_value = other.m_has_value;
+		if(m_has_value)
+			new(&m_value) T(std::move(other.m_value));
+		else
+			new(&m_error) E(std::move(other.m_error));
+		return *this;
+	}
+
+	~expected_storage() { destroy(); }
+
+protected:
+	void destroy() noexcept
+	{
+		if(m_has_value)
+			m_value.~T();
+		else
+			m_error.~E();
+	}
+
+	union {
+		T m_value;
+		E m_error;
+	};
+	bool m_has_value;
+};
+
+
+
+////////////////////////////////////////////
+// expected
+//
+
+template <typename T, typename E>
+class expected;
+
+template <typename T>
+struct is_expected : std::false_type {};
+
+template <typename T, typename E>
+struct is_expected<expected<T, E>> : std::true_type {};
+
+// Either a T, or an E. There is no expected<void, E>, to keep it short.
+// [[nodiscard]] makes the compiler complain when you ignore a returned
+// expected, and therefore its error.
+template <typename T, typename E>
+class [[nodiscard]] expected : private expected_storage<T, E> {
+	static_assert(std::is_nothrow_move_constructible_v<T> && std::is_nothrow_move_constructible_v<E>,
+		"Assignment relies on moves that do not throw");
+	static_assert(!std::is_void_v<T> && !std::is_reference_v<T> && !is_unexpected<T>::value,
+		"Not supported");
+
+	using base = expected_storage<T, E>;
+
+public:
+	using value_type = T;
+	using error_type = E;
+
+	constexpr expected() : base{std::in_place} {}
+
+	template <typename U = T,
+		std::enable_if_t<std::is_constructible_v<T, U&&> &&
+			!std::is_same_v<remove_cvref_t<U>, expected> &&
+			!std::is_same_v<remove_cvref_t<U>, std::in_place_t> &&
+			!std::is_same_v<remove_cvref_t<U>, unexpect_t> &&
+			!is_unexpected<remove_cvref_t<U>>::value, int> = 0>
+	constexpr expected(U&& value)
+		: base{std::in_place, std::forward<U>(value)}
+	{}
+
+	template <typename G>
+	constexpr expected(unexpected<G> const& e)
+		: base{unexpect, e.error()}
+	{}
+
+	template <typename G>
+	constexpr expected(unexpected<G>&& e)
+		: base{unexpect, std::move(e).error()}
+	{}
+
+	template <typename... A>
+	constexpr explicit expected(std::in_place_t, A&&... a)
+		: base{std::in_place, std::forward<A>(a)...}
+	{}
+
+	template <typename... A>
+	constexpr explicit expected(unexpect_t, A&&... a)
+		: base{unexpect, std::forward<A>(a)...}
+	{}
+
+	constexpr bool has_value() const noexcept { return this->m_has_value; }
+	constexpr explicit operator bool() const noexcept { return has_value(); }
+
+	// Unchecked access, like std::optional.
+	constexpr T& operator*() & noexcept { return this->m_value; }
+	constexpr T const& operator*() const& noexcept { return this->m_value; }
+	constexpr T&& operator*() && noexcept { return std::move(this->m_value); }
+	constexpr T* operator->() noexcept { return &this->m_value; }
+	constexpr T const* operator->() const noexcept { return &this->m_value; }
+
+	// Checked access.
+	constexpr T& value() &
+	{
+		check();
+		return this->m_value;
+	}
+
+	constexpr T const& value() const&
+	{
+		check();
+		return this->m_value;
+	}
+
+	constexpr T&& value() &&
+	{
+		check();
+		return std::move(this->m_value);
+	}
+
+	template <typename U>
+	constexpr T value_or(U&& alternative) const&
+	{
+		return has_value() ? this->m_value : static_cast<T>(std::forward<U>(alternative));
+	}
+
+	template <typename U>
+	constexpr T value_or(U&& alternative) &&
+	{
+		return has_value() ? std::move(this->m_value) : static_cast<T>(std::forward<U>(alternative));
+	}
+
+	constexpr E const& error() const& noexcept { return this->m_error; }
+	constexpr E&& error() && noexcept { return std::move(this->m_error); }
+
+	// f(value) returns an expected<U, E>, which is returned. Or the
+	// error is passed on, without calling f.
+	template <typename F>
+	constexpr auto and_then(F&& f) const& { return and_then_impl(*this, std::forward<F>(f)); }
+
+	template <typename F>
+	constexpr auto and_then(F&& f) && { return and_then_impl(std::move(*this), std::forward<F>(f)); }
+
+	// f(value) returns a U, which is returned as expected<U, E>. Or the
+	// error is passed on, without calling f.
+	template <typename F>
+	constexpr auto transform(F&& f) const& { return transform_impl(*this, std::forward<F>(f)); }
+
+	template <typename F>
+	constexpr auto transform(F&& f) && { return transform_impl(std::move(*this), std::forward<F>(f)); }
+
+	// f(error) returns an expected<T, G>, to recover from the error, or
+	// to turn it into another one. Or the value is passed on.
+	template <typename F>
+	constexpr auto or_else(F&& f) const& { return or_else_impl(*this, std::forward<F>(f)); }
+
+	template <typename F>
+	constexpr auto or_else(F&& f) && { return or_else_impl(std::move(*this), std::forward<F>(f)); }
+
+private:
+	constexpr void check() const
+	{
+		if(!has_value())
+			throw bad_expected_access<E>{this->m_error};
+	}
+
+	// The implementations, for const& and && at once. Self is expected
+	// const& or expected.
+	template <typename Self, typename F>
+	static constexpr auto and_then_impl(Self&& self, F&& f)
+	{
+		using R = remove_cvref_t<std::invoke_result_t<F, decltype(*std::forward<Self>(self))>>;
+		static_assert(is_expected<R>::value, "f must return an expected");
+		static_assert(std::is_same_v<typename R::error_type, E>, "f must return the same error type");
+
+		if(self.has_value())
+			return std::invoke(std::forward<F>(f), *std::forward<Self>(self));
+		return R{unexpect, std::forward<Self>(self).error()};
+	}
+
+	template <typename Self, typename F>
+	static constexpr auto transform_impl(Self&& self, F&& f)
+	{
+		using U = remove_cvref_t<std::invoke_result_t<F, decltype(*std::forward<Self>(self))>>;
+		using R = expected<U, E>;
+
+		if(self.has_value())
+			return R{std::in_place, std::invoke(std::forward<F>(f), *std::forward<Self>(self))};
+		return R{unexpect, std::forward<Self>(self).error()};
+	}
+
+	template <typename Self, typename F>
+	static constexpr auto or_else_impl(Self&& self, F&& f)
+	{
+		using R = remove_cvref_t<std::invoke_result_t<F, decltype(std::forward<Self>(self).error())>>;
+		static_assert(is_expected<R>::value, "f must return an expected");
+		static_assert(std::is_same_v<typename R::value_type, T>, "f must return the same value type");
+
+		if(self.has_value())
+			return R{std::in_place, *std::forward<Self>(self)};
+		return std::invoke(std::forward<F>(f), std::forward<Self>(self).error());
+	}
+};
+
+// Plain values are cheap to pass around.
+static_assert(std::is_trivially_copyable_v<expected<int, int>>);
+static_assert(std::is_trivially_copyable_v<expected<double, char const*>>);
+static_assert(sizeof(expected<int, int>) == 2 * sizeof(int));
+static_assert(!std::is_trivially_copyable_v<expected<std::string, int>>);
+static_assert(std::is_copy_constructible_v<expected<std::string, int>>);
+
+
+
+////////////////////////////////////////////
+// Trolls and elves
+//
+
+// Why there is no news.
+enum class why { offline, truth_bomb, too_short };
+
+static char const* what(why w) noexcept
+{
+	switch(w) {
+	case why::offline: return "offline";
+	case why::truth_bomb: return "truth bomb";
+	case why::too_short: return "too short";
+	}
+	return "?";
+}
+
+// troll6 of 20210524_optional, like in 20220214_error_channels.
+static std::string troll6(bool ok, char const* msg)
+{
+	if(ok)
+		return msg;
+
+	throw "Truth bomb";
+}
+
+// The same, but the error is returned, not thrown.
+static expected<std::string, why> troll7(bool ok, char const* msg)
+{
+	if(ok)
+		return msg;
+
+	return unexpected{why::truth_bomb};
+}
+
+// elf1, which now tells why there is nothing.
+static expected<std::string, why> elf2(bool ok, char const* msg)
+{
+	if(ok)
+		return std::string{msg};
+
+	return unexpected{why::offline};
+}
+
+// A next step, which may fail too.
+static expected<size_t, why> long_enough(size_t length)
+{
+	if(length >= 10U)
+		return length;
+
+	return unexpected{why::too_short};
+}
+
+
+
+////////////////////////////////////////////
+// Benchmark
+//
+
+// Both pipelines compute the length of the message, if it is long enough,
+// and 0 on any failure. The loops are called via a function pointer, so they
+// are compiled as separate functions.
+using runner = size_t (*)(char const* ok, size_t n, char const* msg);
+
+static size_t run_string_exceptions(char const* ok, size_t n, char const* msg)
+{
+	size_t sum = 0;
+	for(size_t i = 0; i < n; i++) {
+		try {
+			size_t length = troll6(ok[i] != 0, msg).size();
+			if(length < 10U)
+				throw why::too_short;
+			sum += length;
+		} catch(...) {
+		}
+	}
+	return sum;
+}
+
+static size_t run_string_expected(char const* ok, size_t n, char const* msg)
+{
+	size_t sum = 0;
+	for(size_t i = 0; i < n; i++)
+		sum += troll7(ok[i] != 0, msg)
+			.transform([](std::string const& s) { return s.size(); })
+			.and_then(long_enough)
+			.value_or(0U);
+	return sum;
+}
+
+// The same, without the std::string, so expected<size_t, why> is all there
+// is. That one fits in two registers.
+static size_t run_plain_exceptions(char const* ok, size_t n, char const* msg)
+{
+	auto length = [](bool good, char const* m) -> size_t {
+		if(!good)
+			throw why::truth_bomb;
+		return std::char_traits<char>::length(m);
+	};
+
+	size_t sum = 0;
+	for(size_t i = 0; i < n; i++) {
+		try {
+			sum += length(ok[i] != 0, msg);
+		} catch(...) {
+		}
+	}
+	return sum;
+}
+
+static size_t run_plain_expected(char const* ok, size_t n, char const* msg)
+{
+	auto length = [](bool good, char const* m) -> expected<size_t, why> {
+		if(!good)
+			return unexpected{why::truth_bomb};
+		return std::char_traits<char>::length(m);
+	};
+
+	size_t sum = 0;
+	for(size_t i = 0; i < n; i++)
+		sum += length(ok[i] != 0, msg).value_or(0U);
+	return sum;
+}
+
+struct channel {
+	char const* name;
+	char const* symbol;
+	runner run;
+};
+
+static std::array<channel, 4> const channels{{
+	{"exceptions", "run_string_exceptions", &run_string_exceptions},
+	{"expected", "run_string_expected", &run_string_expected},
+	{"exceptions, no string", "run_plain_exceptions", &run_plain_exceptions},
+	{"expected, no string", "run_plain_expected", &run_plain_expected},
+}};
+
+static int benchmark(char const* msg, size_t n)
+{
+	std::cout << std::endl << n << " calls per cell, ns per call:" << std::endl;
+	std::cout << std::left << std::setw(24) << "success:" << std::right;
+	for(auto r : bench::ratios)
+		std::cout << std::setw(9) << r << "%";
+	std::cout << std::endl;
+
+	std::array<std::vector<char>, bench::ratios.size()> ok;
+	for(size_t r = 0; r < bench::ratios.size(); r++)
+		ok[r] = bench::pattern(n, bench::ratios[r]);
+
+	// Every pair of pipelines should agree.
+	std::array<std::array<size_t, bench::ratios.size()>, channels.size()> sums{};
+
+	std::cout << std::fixed << std::setprecision(2);
+	for(size_t c = 0; c < channels.size(); c++) {
+		std::cout << std::left << std::setw(24) << channels[c].name << std::right;
+		for(size_t r = 0; r < bench::ratios.size(); r++) {
+			perf::sample s = bench::count([&] { sums[c][r] = channels[c].run(ok[r].data(), n, msg); });
+			bench::escape(sums[c][r]);
+			std::cout << std::setw(10) << s.seconds * 1e9 / static_cast<double>(n);
+			bench::counters(s, n);
+		}
+		std::cout << std::endl;
+	}
+	std::cout << std::defaultfloat << std::setprecision(6);
+
+	return sums[0] == sums[1] && sums[2] == sums[3] ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+	char const* msg = "If you don't trust mRNA/vaccine technology, medicine, "
+		"statistics, telecommunication, and journalism, you "
+		"shouldn't trust you phone either.  Wake up.";
+
+	// Like std::optional, but with a reason.
+	for(bool ok : {true, false}) {
+		if(auto x = elf2(ok, msg))
+			std::cout << "expected:  " << x->c_str() << std::endl;
+		else
+			std::cout << "expected:  nothing, because " << what(x.error()) << std::endl;
+	}
+
+	// A pipeline: every step is only run when the previous one
+	// succeeded. The first error is passed to the end, where or_else()
+	// may handle it.
+	auto words = [](std::string const& s) {
+		size_t n = 1;
+		for(char c : s)
+			n += c == ' ' ? 1U : 0U;
+		return n;
+	};
+
+	auto pipeline = [&](bool ok, char const* m) {
+		return troll7(ok, m)
+			.transform(words)
+			.and_then(long_enough)
+			.or_else([](why w) -> expected<size_t, why> {
+				std::cout << "  recovering from " << what(w) << std::endl;
+				return 0U;
+			});
+	};
+
+	auto wake_up = pipeline(true, msg);
+	auto fake = pipeline(true, "Fake news");
+	auto bomb = pipeline(false, msg);
+	std::cout << "words: " << *wake_up << ", " << *fake << ", " << *bomb << std::endl;
+
+	if(*wake_up != 20U || *fake != 0U || *bomb != 0U)
+		return 1;
+
+	// value() checks, like std::optional's, and throws when there is an
+	// error.
+	try {
+		auto x = troll7(false, msg);
+		std::cout << x.value() << std::endl;
+		return 1;
+	} catch(bad_expected_access<why> const& e) {
+		std::cout << "value(): " << e.what() << ", " << what(e.error()) << std::endl;
+	}
+
+	// Uncomment this line, and the compiler complains about the ignored
+	// error, because of [[nodiscard]].
+//	troll7(false, msg);
+
+
+
+	std::cout << std::endl << "Code size (bytes):" << std::endl;
+	for(auto const& c : channels)
+		std::cout << "  " << std::left << std::setw(24) << c.name << std::right
+			<< std::setw(6) << bench::code_size(c.symbol) << std::endl;
+
+	// Try 1000000.
+	size_t n = bench::scale(argc, argv, 10'000);
+	int res = benchmark(msg, n);
+
+	// When nothing fails, both are equally fast. But every failure costs
+	// a throw, a search for the handler and unwinding the stack, which
+	// takes a microsecond or so. For expected, a failure is just a branch.
+	// The price is a bit more code at every call site, and a check that
+	// you cannot forget, as the value is only reachable via the expected.
+	return res;
+}
+
+/*
+ * Further reading:
+ *
+ * https://en.cppreference.com/w/cpp/utility/expected
+ * https://www.open-std.org/jtc1/sc22/wg21/docs/papers/2021/p2505r0.html
+ * https://github.com/TartanLlama/expected
+ *
+ * See also 20210524_optional and 20220214_error_channels.
+ */
@@ -0,0 +1,431 @@
+﻿/*
+ * Static strings
+ *
+ * Every successful call of the trolls and elves of 20210524_optional returns
+ * a std::string, made from a string literal. The text never changes, but
+ * every call copies it, and as it does not fit in the string itself, it is
+ * copied to the heap. For text that lives forever anyway, that is a waste.
+ *
+ * A std::string_view of the literal does not copy anything. The literal is
+ * in static storage, so the view never dangles. Only when the caller really
+ * needs to own the string, for example because the text is built at run
+ * time, it has to live somewhere. Then, a copy-on-write string shares one
+ * immutable copy between all its owners: a copy is just a reference count
+ * increment. Only when one of the owners changes it, it gets its own copy.
+ *
+ * Scroll down to main() and follow the program flow.
+ */
+
+// These includes are just for this example.
+#include "allocations.h"
+#include "bench.h"
+
+#include <algorithm>
+#include <any>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+
+
+////////////////////////////////////////////
+// Copy-on-write string
+//
+
+// An immutable string, shared by all copies. The reference count, the size
+// and the characters are in one allocation. Copying increments the count;
+// appending copies the characters first, unless this is the only owner.
+class cow_string {
+public:
+	cow_string() noexcept = default;
+
+	explicit cow_string(std::string_view s)
+		: m_rep{make(s, s.size())}
+	{}
+
+	cow_string(cow_string const& other) noexcept
+		: m_rep{other.m_rep}
+	{
+		if(m_rep)
+			m_rep->refs.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	cow_string(cow_string&& other) noexcept
+		: m_rep{std::exchange(other.m_rep, nullptr)}
+	{}
+
+	cow_string& operator=(cow_string other) noexcept
+	{
+		std::swap(m_rep, other.m_rep);
+		return *this;
+	}
+
+	~cow_string() { release(m_rep); }
+
+	std::string_view view() const noexcept
+	{
+		return m_rep ? std::string_view{m_rep->data(), m_rep->size} : std::string_view{};
+	}
+
+	operator std::string_view() const noexcept { return view(); }
+	size_t size() const noexcept { return m_rep ? m_rep->size : 0; }
+	char const* c_str() const noexcept { return m_rep ? m_rep->data() : ""; }
+
+	// The number of cow_strings that share these characters.
+	size_t use_count() const noexcept
+	{
+		return m_rep ? m_rep->refs.load(std::memory_order_relaxed) : 0;
+	}
+
+	cow_string& operator+=(std::string_view s)
+	{
+		size_t n = size() + s.size();
+		if(!m_rep || m_rep->refs.load(std::memory_order_acquire) != 1 || m_rep->capacity < n) {
+			// Copy first, as s may point into our own characters.
+			rep* r = make(view(), std::max(n, size() * 2U));
+			std::memcpy(r->data() + r->size, s.data(), s.size());
+			r->size = n;
+			r->data()[n] = '\0';
+			release(std::exchange(m_rep, r));
+		} else {
+			std::memmove(m_rep->data() + m_rep->size, s.data(), s.size());
+			m_rep->size = n;
+			m_rep->data()[n] = '\0';
+		}
+		return *this;
+	}
+
+private:
+	struct rep {
+		std::atomic<size_t> refs;
+		size_t size;
+		size_t capacity;
+
+		// The characters follow the rep.
+		char* data() noexcept { return reinterpret_cast<char*>(this + 1); }
+	};
+
+	static rep* make(std::string_view s, size_t capacity)
+	{
+		auto* r = new(::operator new(sizeof(rep) + capacity + 1U)) rep{{1}, s.size(), capacity};
+		std::memcpy(r->data(), s.data(), s.size());
+		r->data()[s.size()] = '\0';
+		return r;
+	}
+
+	static void release(rep* r) noexcept
+	{
+		if(r && r->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			r->~rep();
+			::operator delete(r);
+		}
+	}
+
+	rep* m_rep = nullptr;
+};
+
+// As small as a pointer, so it fits in a std::any without allocating.
+static_assert(sizeof(cow_string) == sizeof(void*));
+
+
+
+////////////////////////////////////////////
+// Trolls and elves
+//
+
+// The texts of 20210524_optional.
+enum text { five_g, flu_vaccine, dna, aspirin, nanobots, garlic, phone, texts };
+
+static constexpr std::array<std::string_view, texts> text_of{{
+	"5G causes COVID-19 (and I can know, because I have seen an antenna "
+	"once, so I'm an expert)",
+	"COVID-19 is injected together with the flu vaccine (and I know that, "
+	"because I cannot read and certainly do not understand the ingredient "
+	"list, so it must be true)",
+	"The COVID-19 vaccine will modify your DNA (and although I don't know "
+	"what DNA or mRNA stands for, I know it's true, as I do understand all "
+	"principles of vaccines, obviously)",
+	"The true cause of death of COVID-19 is thrombosis, and aspirin cures "
+	"it (and all the medical staff on the IC missed this note on Facebook, "
+	"which is stupid, as Facebook is known to be a reliable source of "
+	"information -- I am certain, as I also read some story about trolls "
+	"and elves online, which is also true)",
+	"The COVID-19 vaccine contains nanobots that let the government "
+	"control you remotely (and the fact that you can't see them in the "
+	"transparent vaccines, proves that they are really nano -- QED)",
+	"Garlic protects against COVID-19 (well, it doesn't do anything "
+	"against a virus, but it will keep other people at a distance -- and "
+	"that helps, especially if these people say really stupid things)",
+	"If you don't trust mRNA/vaccine technology, medicine, statistics, "
+	"telecommunication, and journalism, you shouldn't trust you phone "
+	"either.  Wake up.",
+}};
+
+// The text, as an S. A std::string is made for every call, like "..."s
+// does. A std::string_view and a cow_string refer to one static copy.
+template <typename S, text T>
+static S message()
+{
+	if constexpr(std::is_same_v<S, std::string>) {
+		return S{text_of[T]};
+	} else {
+		static S const s{text_of[T]};
+		return s;
+	}
+}
+
+// The functions of 20210524_optional, for any string type S. The caller
+// decides whether there is a result.
+template <typename S>
+static std::pair<S, bool> troll2(bool ok)
+{
+	return ok ? std::make_pair(message<S, five_g>(), true) : std::make_pair(S{}, false);
+}
+
+template <typename S>
+static std::tuple<S, bool> troll3(bool ok)
+{
+	return ok ? std::make_tuple(message<S, flu_vaccine>(), true) : std::make_tuple(S{}, false);
+}
+
+template <typename S>
+static std::variant<std::monostate, S> troll4(bool ok)
+{
+	std::variant<std::monostate, S> res;
+	return ok ? res = message<S, dna>() : res;
+}
+
+template <typename S>
+static std::any troll5(bool ok)
+{
+	return ok ? std::any{message<S, aspirin>()} : std::any{};
+}
+
+template <typename S>
+static S troll6(bool ok)
+{
+	if(ok)
+		return message<S, nanobots>();
+
+	throw "Truth bomb";
+}
+
+template <typename S>
+static std::optional<S> elf0(bool ok)
+{
+	std::optional<S> res;
+
+	if(ok)
+		res = message<S, garlic>();
+
+	return res;
+}
+
+template <typename S>
+static std::optional<S> elf1(bool ok)
+{
+	if(ok)
+		return message<S, phone>();
+
+	return std::nullopt;
+}
+
+
+
+////////////////////////////////////////////
+// Benchmark
+//
+
+using runner = size_t (*)(char const* ok, size_t n);
+
+template <typename S>
+static size_t run_troll2(char const* ok, size_t n)
+{
+	size_t sum = 0;
+	for(size_t i = 0; i < n; i++)
+		if(auto x = troll2<S>(ok[i] != 0); x.second)
+			sum += x.first.size();
+	return sum;
+}
+
+template <typename S>
+static size_t run_troll3(char const* ok, size_t n)
+{
+	size_t sum = 0;
+	for(size_t i = 0; i < n; i++)
+		if(auto x = troll3<S>(ok[i] != 0); std::get<bool>(x))
+			sum += std::get<S>(x).size();
+	return sum;
+}
+
+template <typename S>
+static size_t run_troll4(char const* ok, size_t n)
+{
+	size_t sum = 0;
+	for(size_t i = 0; i < n; i++)
+		if(auto x = troll4<S>(ok[i] != 0); auto* p = std::get_if<S>(&x))
+			sum += p->size();
+	return sum;
+}
+
+template <typename S>
+static size_t run_troll5(char const* ok, size_t n)
+{
+	size_t sum = 0;
+	for(size_t i = 0; i < n; i++)
+		if(auto x = troll5<S>(ok[i] != 0); auto* p = std::any_cast<S>(&x))
+			sum += p->size();
+	return sum;
+}
+
+template <typename S>
+static size_t run_troll6(char const* ok, size_t n)
+{
+	size_t sum = 0;
+	for(size_t i = 0; i < n; i++) {
+		try {
+			sum += troll6<S>(ok[i] != 0).size();
+		} catch(char const*) {
+		}
+	}
+	return sum;
+}
+
+template <typename S>
+static size_t run_elf0(char const* ok, size_t n)
+{
+	size_t sum = 0;
+	for(size_t i = 0; i < n; i++)
+		if(auto x = elf0<S>(ok[i] != 0); x.has_value())
+			sum += x.value().size();
+	return sum;
+}
+
+template <typename S>
+static size_t run_elf1(char const* ok, size_t n)
+{
+	size_t sum = 0;
+	for(size_t i = 0; i < n; i++)
+		if(auto x = elf1<S>(ok[i] != 0))
+			sum += x->size();
+	return sum;
+}
+
+static constexpr std::array<char const*, 7> names{
+	"pair", "tuple", "variant", "any", "exceptions", "optional 1", "optional 2"};
+
+template <typename S>
+static constexpr std::array<runner, names.size()> runners{
+	&run_troll2<S>, &run_troll3<S>, &run_troll4<S>, &run_troll5<S>,
+	&run_troll6<S>, &run_elf0<S>, &run_elf1<S>};
+
+static int benchmark(size_t n)
+{
+	// All calls succeed; only the result is interesting here.
+	std::vector<char> ok(n, 1);
+
+	std::array<std::array<runner, names.size()>, 3> all{
+		runners<std::string>, runners<std::string_view>, runners<cow_string>};
+
+	std::cout << std::endl << n << " calls per cell, time and allocations per call:" << std::endl;
+	std::cout << std::left << std::setw(12) << "" << std::right
+		<< std::setw(18) << "std::string"
+		<< std::setw(18) << "std::string_view"
+		<< std::setw(18) << "cow_string" << std::endl;
+
+	int res = 0;
+	std::cout << std::fixed << std::setprecision(2);
+	for(size_t f = 0; f < names.size(); f++) {
+		std::cout << std::left << std::setw(12) << names[f] << std::right;
+		std::array<size_t, all.size()> sums{};
+		for(size_t s = 0; s < all.size(); s++) {
+			size_t before = bench::allocations();
+			perf::sample t = bench::count([&] { sums[s] = all[s][f](ok.data(), n); });
+			bench::escape(sums[s]);
+			auto nn = static_cast<double>(n);
+			std::cout << std::setw(8) << t.seconds * 1e9 / nn << " ns "
+				<< std::setw(4) << static_cast<double>(bench::allocations() - before) / nn << " a";
+			bench::counters(t, n);
+		}
+		std::cout << std::endl;
+
+		if(sums[0] != sums[1] || sums[0] != sums[2])
+			res = 1;
+	}
+	std::cout << std::defaultfloat << std::setprecision(6);
+	return res;
+}
+
+int main(int argc, char** argv)
+{
+	// The same results, but as a view of the literal. Nothing is copied.
+	if(auto x = elf1<std::string_view>(true))
+		std::cout << "optional 2:  " << *x << std::endl;
+
+	// The view points to static storage, so it can be kept as long as you
+	// like. Never return a view of a local std::string, though; that one
+	// is gone as soon as the function returns.
+	std::optional<std::string_view> kept = elf0<std::string_view>(true);
+
+
+
+	// When the string is built at run time, someone has to own it. Copies of
+	// a cow_string share it, without allocating.
+	cow_string rumor{"Bill Gates"};
+	rumor += " invented ";
+	rumor += "5G";
+
+	size_t a = bench::allocations();
+	cow_string forwarded = rumor;
+	std::vector<cow_string> timeline(10, forwarded);
+	size_t copies = bench::allocations() - a - 1U; // One for the vector itself.
+
+	std::cout << "rumor:       " << rumor.c_str() << " (shared by " << rumor.use_count() << ")" << std::endl;
+
+	// Changing a copy gives it its own characters; the others do not
+	// notice.
+	forwarded += ", obviously";
+	std::cout << "forwarded:   " << forwarded.c_str() << " (shared by " << forwarded.use_count() << ")" << std::endl;
+	std::cout << "rumor:       " << rumor.c_str() << " (shared by " << rumor.use_count() << ")" << std::endl;
+
+	if(copies != 0 || rumor.use_count() != 11U || forwarded.use_count() != 1U ||
+		rumor.view() != "Bill Gates invented 5G" || !kept || kept->size() != text_of[garlic].size())
+		return 1;
+
+
+
+	// Try 1000000.
+	size_t n = bench::scale(argc, argv, 10'000);
+	int res = benchmark(n);
+
+	// The std::string of every call allocates, as the texts are too long
+	// for the small string optimization. The std::string_view results do
+	// not allocate at all, and are much faster. Except in a std::any: a
+	// std::string_view is two pointers, which is too large for the buffer
+	// of std::any in some implementations. The cow_string is as small as
+	// one pointer, and needs only an atomic increment and decrement per
+	// call.
+	return res;
+}
+
+/*
+ * Further reading:
+ *
+ * https://en.cppreference.com/w/cpp/string/basic_string_view
+ * https://en.wikipedia.org/wiki/Copy-on-write
+ * https://www.open-std.org/jtc1/sc22/wg21/docs/papers/2008/n2668.htm
+ *
+ * See also 20210524_optional, 20220214_error_channels and 20220221_expected.
+ */
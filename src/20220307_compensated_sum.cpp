@@ -0,0 +1,444 @@
+﻿/*
+ * Compensated summation
+ *
+ * earth_ratio_to_plant_forest_to_consume_CO2eq_production() of
+ * 20210531_init_list adds doubles, one after another. Every addition rounds
+ * the result to 53 bits. When the running total gets large compared to the
+ * values that are added, more and more of these values are rounded away. For
+ * five years of emissions, nobody notices. For a billion samples, the error
+ * grows with the number of elements.
+ *
+ * Kahan's, or rather Neumaier's, summation keeps track of what was rounded
+ * away in a second variable, and adds it back at the end. Then, the error
+ * does not depend on the number of elements anymore. Pairwise summation
+ * (adding halves recursively) is cheaper, and its error only grows with the
+ * logarithm of the number of elements.
+ *
+ * Both are a few more additions per element. If you do it right, the CPU
+ * does them in parallel, and the sum is still limited by how fast memory
+ * delivers the data, not by the arithmetic.
+ *
+ * Scroll down to main() and follow the program flow.
+ */
+
+// These includes are just for this example.
+#include "bench.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <numeric>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+
+////////////////////////////////////////////
+// Series
+//
+
+// A view of values to sum: an initializer_list, any contiguous container, or
+// every stride-th element of an array, like one column of a matrix.
+template <typename T>
+class series {
+public:
+	static_assert(std::is_arithmetic_v<T>);
+
+	constexpr series(T const* data, size_t size, size_t stride = 1U) noexcept
+		: m_data{data}
+		, m_size{size}
+		, m_stride{stride > 0 ? stride : 1U}
+	{}
+
+	// The list is only alive until the end of the full expression, so
+	// only use this one to pass a list to a function directly.
+	constexpr series(std::initializer_list<T> l) noexcept
+		: series{l.begin(), l.size()}
+	{}
+
+	template <typename C, typename = decltype(std::data(std::declval<C const&>()))>
+	constexpr series(C const& c) noexcept
+		: series{std::data(c), std::size(c)}
+	{}
+
+	constexpr T const* data() const noexcept { return m_data; }
+	constexpr size_t size() const noexcept { return m_size; }
+	constexpr size_t stride() const noexcept { return m_stride; }
+	constexpr bool contiguous() const noexcept { return m_stride == 1U; }
+	constexpr T const& operator[](size_t i) const noexcept { return m_data[i * m_stride]; }
+
+	// count elements, starting at offset.
+	constexpr series sub(size_t offset, size_t count) const noexcept
+	{
+		return {m_data + offset * m_stride, count, m_stride};
+	}
+
+private:
+	T const* m_data;
+	size_t m_size;
+	size_t m_stride;
+};
+
+
+
+////////////////////////////////////////////
+// Kernels
+//
+
+// What to do with a NaN: let it make the result NaN, like any arithmetic
+// does, or pretend it is not there.
+enum class nan_policy { propagate, skip };
+
+enum class method { naive, pairwise, neumaier };
+
+// A running sum, and what was rounded away. This is Neumaier's variant of
+// Kahan's summation: it also works when x is larger than the sum so far.
+struct neumaier {
+	double sum = 0;
+	double compensation = 0;
+
+	void add(double x) noexcept
+	{
+		double t = sum + x;
+		double big_sum = (sum - t) + x;
+		double big_x = (x - t) + sum;
+		compensation += std::abs(sum) >= std::abs(x) ? big_sum : big_x;
+		sum = t;
+	}
+
+	// Once the sum is infinite, the compensation is inf - inf, which is NaN.
+	// Only a finite sum has a meaningful compensation.
+	void add(neumaier const& other) noexcept
+	{
+		add(other.sum);
+		if(std::isfinite(other.sum))
+			compensation += other.compensation;
+	}
+
+	double result() const noexcept { return std::isfinite(sum) ? sum + compensation : sum; }
+};
+
+// The kernels use several independent accumulators. One accumulator would
+// make every addition wait for the previous one. With eight, the CPU keeps
+// its adders busy, and the compiler can put them in vector registers. This
+// is plain C++, so it works for SSE, AVX, NEON or whatever the target has.
+// Do not compile it with -ffast-math: then the compiler may decide that the
+// compensation is always zero, and remove it.
+static constexpr size_t lanes = 8;
+
+template <nan_policy P, typename T>
+static double value(T x) noexcept
+{
+	auto d = static_cast<double>(x);
+	if constexpr(P == nan_policy::skip)
+		return std::isnan(d) ? 0.0 : d;
+	else
+		return d;
+}
+
+// Contiguous is a compile-time constant, such that the compiler knows the
+// stride of the common case.
+template <nan_policy P, bool Contiguous, typename T>
+static double naive_sum(series<T> const& s) noexcept
+{
+	size_t stride = Contiguous ? 1U : s.stride();
+	T const* x = s.data();
+	size_t n = s.size();
+
+	std::array<double, lanes> acc{};
+	size_t i = 0;
+	for(; i + lanes <= n; i += lanes)
+		for(size_t j = 0; j < lanes; j++)
+			acc[j] += value<P>(x[(i + j) * stride]);
+
+	double sum = 0;
+	for(; i < n; i++)
+		sum += value<P>(x[i * stride]);
+	for(auto a : acc)
+		sum += a;
+	return sum;
+}
+
+template <nan_policy P, bool Contiguous, typename T>
+static neumaier neumaier_sum(series<T> const& s) noexcept
+{
+	size_t stride = Contiguous ? 1U : s.stride();
+	T const* x = s.data();
+	size_t n = s.size();
+
+	// The same as neumaier::add(), but with the sums and compensations in
+	// separate arrays. And instead of comparing which one is larger,
+	// Knuth's TwoSum computes the rounding error with two more
+	// subtractions. That is the same error, without any control flow in
+	// the loop, so the compiler can vectorize it.
+	std::array<double, lanes> sums{};
+	std::array<double, lanes> compensations{};
+	size_t i = 0;
+	for(; i + lanes <= n; i += lanes) {
+		for(size_t j = 0; j < lanes; j++) {
+			double v = value<P>(x[(i + j) * stride]);
+			double t = sums[j] + v;
+			double z = t - sums[j];
+			compensations[j] += (sums[j] - (t - z)) + (v - z);
+			sums[j] = t;
+		}
+	}
+
+	neumaier sum;
+	for(; i < n; i++)
+		sum.add(value<P>(x[i * stride]));
+	for(size_t j = 0; j < lanes; j++)
+		sum.add(neumaier{sums[j], compensations[j]});
+	return sum;
+}
+
+// Blocks are summed naively; the blocks are added in a tree.
+static constexpr size_t pairwise_block = 256;
+
+template <nan_policy P, bool Contiguous, typename T>
+static double pairwise_sum(series<T> const& s) noexcept
+{
+	size_t n = s.size();
+	if(n <= pairwise_block)
+		return naive_sum<P, Contiguous>(s);
+
+	size_t half = (n / 2U + pairwise_block - 1U) / pairwise_block * pairwise_block;
+	return pairwise_sum<P, Contiguous>(s.sub(0, half)) +
+		pairwise_sum<P, Contiguous>(s.sub(half, n - half));
+}
+
+template <nan_policy P, bool Contiguous, typename T>
+static neumaier sum_as(series<T> const& s, method m) noexcept
+{
+	switch(m) {
+	case method::naive: return {naive_sum<P, Contiguous>(s), 0};
+	case method::pairwise: return {pairwise_sum<P, Contiguous>(s), 0};
+	case method::neumaier: break;
+	}
+	return neumaier_sum<P, Contiguous>(s);
+}
+
+template <typename T>
+static neumaier sum_of(series<T> const& s, nan_policy p, method m) noexcept
+{
+	if(s.contiguous())
+		return p == nan_policy::skip
+			? sum_as<nan_policy::skip, true>(s, m)
+			: sum_as<nan_policy::propagate, true>(s, m);
+	else
+		return p == nan_policy::skip
+			? sum_as<nan_policy::skip, false>(s, m)
+			: sum_as<nan_policy::propagate, false>(s, m);
+}
+
+
+
+////////////////////////////////////////////
+// Sum
+//
+
+template <typename T>
+double sum(series<T> const& s, nan_policy p = nan_policy::propagate, method m = method::neumaier) noexcept
+{
+	return sum_of(s, p, m).result();
+}
+
+// A series<T> cannot be deduced from {...} or a container, so pass them on.
+template <typename T>
+double sum(std::initializer_list<T> l, nan_policy p = nan_policy::propagate, method m = method::neumaier) noexcept
+{
+	return sum(series<T>{l}, p, m);
+}
+
+template <typename C, typename T = std::remove_cv_t<std::remove_pointer_t<decltype(std::data(std::declval<C const&>()))>>>
+double sum(C const& c, nan_policy p = nan_policy::propagate, method m = method::neumaier) noexcept
+{
+	return sum(series<T>{c}, p, m);
+}
+
+// The series is cut into fixed chunks, which the threads take one by one.
+// The partial sums are combined in chunk order. So, the result does not
+// depend on the number of threads, or on which thread did which chunk.
+static constexpr size_t chunk_size = 1U << 16U;
+
+template <typename T>
+double parallel_sum(series<T> const& s, nan_policy p = nan_policy::propagate, size_t threads = 0)
+{
+	size_t chunks = (s.size() + chunk_size - 1U) / chunk_size;
+	if(threads == 0)
+		threads = std::max<size_t>(std::thread::hardware_concurrency(), 1U);
+	threads = std::min(threads, chunks);
+
+	std::vector<neumaier> partial(chunks);
+	std::atomic<size_t> next{0};
+	auto worker = [&]() noexcept {
+		for(size_t c = next++; c < chunks; c = next++)
+			partial[c] = sum_of(s.sub(c * chunk_size, std::min(chunk_size, s.size() - c * chunk_size)),
+				p, method::neumaier);
+	};
+
+	std::vector<std::thread> pool;
+	for(size_t t = 1; t < threads; t++)
+		pool.emplace_back(worker);
+	worker();
+	for(auto& t : pool)
+		t.join();
+
+	neumaier total;
+	for(auto const& c : partial)
+		total.add(c);
+	return total.result();
+}
+
+
+
+////////////////////////////////////////////
+// Emissions
+//
+
+// 20210531_init_list's function, with a proper sum, and a choice what to do
+// with missing data.
+template <typename T>
+double earth_ratio_to_plant_forest_to_consume_CO2eq_production(
+	std::initializer_list<T> l, nan_policy p = nan_policy::propagate)
+{
+	return sum(l, p)         // CO2eq in Gt
+		/ ( 510.1e12     // Earth surface in m2
+		  * 0.6177       // absorb kg CO2/m2 forest/year
+		  * 1e-12 );     // kg to Gt
+}
+
+template <typename S>
+static double relative_error(S const& s, double exact)
+{
+	return std::abs(s - exact) / std::abs(exact);
+}
+
+int main(int argc, char** argv)
+{
+	constexpr double nan = std::numeric_limits<double>::quiet_NaN();
+
+	// Shell scope 3 emission, 2016-2020. The 2020 data is missing.
+	double with = earth_ratio_to_plant_forest_to_consume_CO2eq_production(
+		{1.545, 1.591, 1.637, 1.551, nan});
+	double without = earth_ratio_to_plant_forest_to_consume_CO2eq_production(
+		{1.545, 1.591, 1.637, 1.551, nan}, nan_policy::skip);
+	std::cout << "Shell scope 3 emission compensation forest (2016-2019) [number of Earths]: "
+		<< with << " (propagate), " << without << " (skip)" << std::endl;
+
+	// The same for a std::vector, and for every other element only.
+	std::vector global_annual_GtCO2eq_emission{50.0, 50.7, 51.9, 52.4, nan};
+	double global = sum(global_annual_GtCO2eq_emission, nan_policy::skip);
+	double odd = sum(series<double>{global_annual_GtCO2eq_emission.data(), 2, 2});
+	std::cout << "Global emission 2016-2019: " << global << " Gt, 2016 and 2018: " << odd << " Gt" << std::endl;
+
+	if(!std::isnan(with) || std::isnan(without) || std::abs(global - 205.0) > 1e-12 || std::abs(odd - 101.9) > 1e-12)
+		return 1;
+
+	// The classic example: the 1s are rounded away by the naive sum, and
+	// by pairwise summation. Kahan's original algorithm loses them too,
+	// as the second value is larger than the first.
+	std::array<double, 4> tricky{1.0, 1e100, 1.0, -1e100};
+	std::cout << "1 + 1e100 + 1 - 1e100 = "
+		<< sum(tricky, nan_policy::propagate, method::naive) << " (naive), "
+		<< sum(tricky, nan_policy::propagate, method::pairwise) << " (pairwise), "
+		<< sum(tricky) << " (Neumaier)" << std::endl;
+
+	if(sum(tricky) != 2.0)
+		return 1;
+
+	// An infinite element makes the sum infinite, not NaN. Also when it is
+	// in one of the accumulators of the kernel, or in one of the chunks.
+	constexpr double inf = std::numeric_limits<double>::infinity();
+	std::vector<double> huge(3 * lanes, 1.0);
+	huge[lanes + 1] = -inf;
+	std::cout << "1 + inf = " << sum({1.0, inf}) << ", sum with -inf = " << sum(huge) << std::endl;
+
+	if(sum({1.0, inf}, nan_policy::propagate, method::naive) != inf ||
+		sum({1.0, inf}, nan_policy::propagate, method::pairwise) != inf ||
+		sum({1.0, inf}) != inf || sum(huge) != -inf ||
+		parallel_sum<double>(huge) != -inf || !std::isnan(sum({inf, -inf})))
+		return 1;
+
+
+
+	// Try 1000000000, if you have 8 GB to spare.
+	size_t n = bench::scale(argc, argv, 100'000);
+
+	// 0.1 cannot be represented exactly. The exact sum of n times that
+	// value is known, though.
+	std::vector<double> tenths(n, 0.1);
+	double exact = 0.1 * static_cast<double>(n);
+
+	std::cout << std::endl << "Relative error of summing " << n << " times 0.1:" << std::endl;
+	double plain = std::accumulate(tenths.begin(), tenths.end(), 0.0);
+	std::cout << "  std::accumulate " << relative_error(plain, exact) << std::endl;
+	std::cout << "  pairwise        " << relative_error(sum(tenths, nan_policy::propagate, method::pairwise), exact) << std::endl;
+	std::cout << "  Neumaier        " << relative_error(sum(tenths), exact) << std::endl;
+	std::cout << "  parallel        " << relative_error(parallel_sum<double>(tenths), exact) << std::endl;
+
+	if(relative_error(sum(tenths), exact) > 1e-15 ||
+		parallel_sum<double>(tenths, nan_policy::propagate, 1) != parallel_sum<double>(tenths, nan_policy::propagate, 3))
+		return 1;
+
+	// Now, some speed, with data that the branch predictor cannot guess.
+	std::vector<double> data(n);
+	uint32_t x = 1;
+	for(auto& d : data) {
+		x = x * 1664525U + 1013904223U;
+		d = static_cast<double>(x) * 1e-6 - 2000.0;
+	}
+
+	std::cout << std::endl << "Summing " << n << " doubles:" << std::endl;
+	std::array<double, 7> sums{};
+	auto bytes = static_cast<double>(n * sizeof(double));
+	auto run = [&](char const* name, double& res, auto f) {
+		double s = bench::measure(name, n, [&] { res = f(); bench::escape(res); });
+		std::cout << "  " << std::setw(40) << "" << std::setw(12) << std::fixed << std::setprecision(2)
+			<< (s > 0 ? bytes / s * 1e-9 : 0.0) << " GB/s" << std::defaultfloat << std::setprecision(6) << std::endl;
+	};
+
+	run("std::accumulate", sums[0], [&] { return std::accumulate(data.begin(), data.end(), 0.0); });
+	run("naive, 8 lanes", sums[1], [&] { return sum(data, nan_policy::propagate, method::naive); });
+	run("pairwise", sums[2], [&] { return sum(data, nan_policy::propagate, method::pairwise); });
+	run("Neumaier", sums[3], [&] { return sum(data); });
+	run("Neumaier, skip NaN", sums[4], [&] { return sum(data, nan_policy::skip); });
+	// The hardware counters only count this thread, which mostly waits
+	// here. Only the time is meaningful for this one.
+	run("Neumaier, parallel", sums[5], [&] { return parallel_sum<double>(data); });
+
+	// Every other element: the same number of bytes from memory, but half
+	// the work.
+	run("Neumaier, stride 2", sums[6], [&] { return 2.0 * sum(series<double>{data.data(), n / 2U, 2}); });
+
+	// All sums are about equal; the compensated ones exactly.
+	if(sums[3] != sums[4] || relative_error(sums[5], sums[3]) > 1e-15)
+		return 1;
+
+	// The naive sum with 8 lanes is as fast as memory allows, and so is
+	// pairwise summation. The compensated sum needs four times as many
+	// additions. Vectorized, that brings it close to memory speed; more
+	// threads, or a CPU with wider vectors, close the gap. For small
+	// series in the cache, the naive sum wins, but it is accurate enough
+	// for small series anyway.
+}
+
+/*
+ * Further reading:
+ *
+ * https://en.wikipedia.org/wiki/Kahan_summation_algorithm
+ * https://en.wikipedia.org/wiki/Pairwise_summation
+ * https://docs.oracle.com/cd/E19957-01/806-3568/ncg_goldberg.html
+ *
+ * See also 20210531_init_list.
+ */
@@ -0,0 +1,178 @@
+﻿/*
+ * Performance counters
+ *
+ * Two loops can take the same number of instructions, and still differ ten
+ * times in speed. The time alone does not tell why. The CPU does know: it
+ * counts cycles, instructions, branches that it guessed wrong, and loads
+ * that missed the cache. perf.h reads these counters via Linux'
+ * perf_event_open(), for the current thread only, without any external
+ * tool.
+ *
+ * Here, two classic experiments: a branch that depends on random data, and
+ * the same data visited in a random order. Configure with
+ * -DWITH_PERF_COUNTERS=ON to get the same numbers from every benchmark in
+ * this repository.
+ *
+ * Scroll down to main() and follow the program flow.
+ */
+
+// These includes are just for this example.
+#include "bench.h"
+#include "perf.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <vector>
+
+// Print the time, and the counters that could be counted, per operation.
+static void report(char const* name, perf::sample const& s, size_t ops)
+{
+	auto n = static_cast<double>(ops > 0 ? ops : 1);
+	auto counter = [](double value, bool valid) -> std::ostream& {
+		if(valid)
+			return std::cout << std::setw(9) << value;
+		return std::cout << std::setw(9) << "n/a";
+	};
+
+	std::cout << "  " << std::left << std::setw(24) << name << std::right
+		<< std::fixed << std::setprecision(2) << std::setw(9) << s.seconds * 1e9 / n;
+	counter(s.per(perf::cycles, ops), s.has(perf::cycles));
+	counter(s.ipc(), s.has(perf::cycles) && s.has(perf::instructions));
+	counter(s.branch_miss_rate() * 100.0, s.has(perf::branches) && s.has(perf::branch_misses));
+	counter(s.mpki(perf::l1d_misses), s.has(perf::l1d_misses) && s.has(perf::instructions));
+	counter(s.mpki(perf::llc_misses), s.has(perf::llc_misses) && s.has(perf::instructions));
+	std::cout << std::defaultfloat << std::setprecision(6) << std::endl;
+}
+
+static void header(char const* title)
+{
+	std::cout << std::endl << title << std::endl
+		<< "  " << std::left << std::setw(24) << "" << std::right
+		<< std::setw(9) << "ns/op" << std::setw(9) << "cyc/op" << std::setw(9) << "IPC"
+		<< std::setw(9) << "br-miss%" << std::setw(9) << "L1d-MPKI" << std::setw(9) << "LLC-MPKI"
+		<< std::endl;
+}
+
+// Add all values from 128 on.
+static long sum_large(std::vector<uint8_t> const& data)
+{
+	long sum = 0;
+	for(auto x : data)
+		if(x >= 128U)
+			sum += x;
+	return sum;
+}
+
+static long sum_via(std::vector<uint8_t> const& data, std::vector<uint32_t> const& order)
+{
+	long sum = 0;
+	for(auto i : order)
+		sum += data[i];
+	return sum;
+}
+
+int main(int argc, char** argv)
+{
+	// One group of counters. Opening them may fail; then, only the time
+	// is measured.
+	perf::counters counters;
+	if(counters.available())
+		std::cout << "Hardware performance counters are available." << std::endl;
+	else
+		std::cout << "Hardware performance counters are not available. Not on Linux, in a "
+			"container, or /proc/sys/kernel/perf_event_paranoid is too strict?" << std::endl;
+
+	// Try 100000000.
+	size_t n = bench::scale(argc, argv, 100'000);
+
+	std::vector<uint8_t> data(n);
+	uint32_t x = 1;
+	for(auto& d : data) {
+		x = x * 1664525U + 1013904223U;
+		d = static_cast<uint8_t>(x >> 24U);
+	}
+
+	std::vector<uint8_t> sorted = data;
+	std::sort(sorted.begin(), sorted.end());
+
+	// The same values, and the same instructions. With random data, the
+	// CPU guesses the branch wrong half of the time, and every wrong guess
+	// throws away the work of 15-20 cycles.
+	header("Branch on random data:");
+	perf::sample random_branch;
+	perf::sample sorted_branch;
+	std::array<long, 4> sums{};
+
+	{
+		// counter_scope counts until the end of the scope.
+		perf::counter_scope scope{random_branch, counters};
+		sums[0] = sum_large(data);
+		bench::escape(sums[0]);
+	}
+	report("random", random_branch, n);
+
+	{
+		perf::counter_scope scope{sorted_branch, counters};
+		sums[1] = sum_large(sorted);
+		bench::escape(sums[1]);
+	}
+	report("sorted", sorted_branch, n);
+
+	// Again the same instructions, but now the order in which the bytes
+	// are visited differs. In order, a cache line brings 64 bytes at once,
+	// and the prefetcher brings the next one in time. In random order,
+	// almost every byte is a cache miss, once the data does not fit in the
+	// cache anymore.
+	std::vector<uint32_t> order(n);
+	std::iota(order.begin(), order.end(), 0U);
+	std::vector<uint32_t> shuffled = order;
+	for(size_t i = n; i > 1; i--) {
+		x = x * 1664525U + 1013904223U;
+		std::swap(shuffled[i - 1U], shuffled[static_cast<size_t>((uint64_t{x} * i) >> 32U)]);
+	}
+
+	header("Memory access order:");
+	perf::sample sequential;
+	perf::sample random_access;
+
+	{
+		perf::counter_scope scope{sequential, counters};
+		sums[2] = sum_via(data, order);
+		bench::escape(sums[2]);
+	}
+	report("sequential", sequential, n);
+
+	{
+		perf::counter_scope scope{random_access, counters};
+		sums[3] = sum_via(data, shuffled);
+		bench::escape(sums[3]);
+	}
+	report("random", random_access, n);
+
+	if(sums[0] != sums[1] || sums[2] != sums[3])
+		return 1;
+
+	// Without counters, you only see that random is slower. With them,
+	// you see why: the branch-miss rate for the branch, and the cache
+	// misses per 1000 instructions for the memory access. A low IPC
+	// means that the CPU is waiting, for whatever reason.
+	//
+	// Note that an optimizing compiler may turn the branch into a
+	// conditional move. Then, sorting does not matter anymore, and the
+	// counters show that too.
+}
+
+/*
+ * Further reading:
+ *
+ * https://man7.org/linux/man-pages/man2/perf_event_open.2.html
+ * https://www.kernel.org/doc/html/latest/admin-guide/perf-security.html
+ * https://stackoverflow.com/questions/11227809/why-is-processing-a-sorted-array-faster-than-processing-an-unsorted-array
+ *
+ * See also 20210607_attributes and bench.h.
+ */
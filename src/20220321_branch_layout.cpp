@@ -0,0 +1,269 @@
+﻿/*
+ * Branch layout
+ *
+ * explain() of 20210607_attributes marks if(!ufo) as [[likely]], and case 4
+ * too. That tells the compiler which way to lay out the code: the likely
+ * path falls through, the unlikely one jumps away, maybe even to a cold
+ * section at the end of the program. But does it make any difference?
+ *
+ * The CPU does not read these hints. It has its own branch predictor, which
+ * learns from history. A hint only changes the layout, which costs a taken
+ * jump or a cache line here and there. A wrong hint is not a disaster either;
+ * the predictor is not misled by it. So, let's measure: the same function
+ * without hints, with correct and wrong hints, with the old
+ * __builtin_expect, and with the unlikely path moved to a cold function. And
+ * with inputs where the likely path is taken 0% to 100% of the time, in a
+ * random or a regular pattern.
+ *
+ * Scroll down to main() and follow the program flow.
+ */
+
+// These includes are just for this example.
+#include "bench.h"
+#include "perf.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#if defined(__GNUC__) || defined(__clang__)
+#  define EXPECT(x, v) __builtin_expect((x), (v))
+#else
+#  define EXPECT(x, v) (x)
+#endif
+
+
+
+////////////////////////////////////////////
+// explain()
+//
+
+// explain(), without the printing. The result says which way it went. The
+// UFO path does a bit of work, like the printing, such that there is some
+// code to lay out.
+static int truth(int count) noexcept
+{
+	int x = count;
+	for(int i = 0; i < 4; i++)
+		x = x * 31 + i;
+	return x & 0xff;
+}
+
+static int explain_plain(bool ufo, int count) noexcept
+{
+	if(!ufo)
+		return 0;
+
+	int r = truth(count);
+	switch(count) {
+	case 0: return r + 1;
+	case 1: return r + 2;
+	case 4: r += 4; [[fallthrough]];
+	case 5:
+	default: return r + 5;
+	}
+}
+
+// The hints of 20210607_attributes.
+static int explain_likely(bool ufo, int count) noexcept
+{
+	if(!ufo) [[likely]]
+		return 0;
+
+	int r = truth(count);
+	switch(count) {
+	case 0: return r + 1;
+	case 1: return r + 2;
+	[[likely]] case 4: r += 4; [[fallthrough]];
+	case 5:
+	default: return r + 5;
+	}
+}
+
+// The opposite.
+static int explain_wrong(bool ufo, int count) noexcept
+{
+	if(!ufo) [[unlikely]]
+		return 0;
+
+	int r = truth(count);
+	switch(count) {
+	case 0: return r + 1;
+	case 1: return r + 2;
+	[[unlikely]] case 4: r += 4; [[fallthrough]];
+	case 5:
+	default: return r + 5;
+	}
+}
+
+// Before C++20, and what the Linux kernel's likely() does.
+static int explain_expect(bool ufo, int count) noexcept
+{
+	if(EXPECT(!ufo, 1))
+		return 0;
+
+	int r = truth(count);
+	switch(count) {
+	case 0: return r + 1;
+	case 1: return r + 2;
+	case 4: r += 4; [[fallthrough]];
+	case 5:
+	default: return r + 5;
+	}
+}
+
+// The UFO path in a function of its own, which the compiler places with the
+// other cold code, away from the hot code. Then, the hot path stays small,
+// and uses fewer cache lines.
+[[gnu::cold, gnu::noinline]] static int explain_ufo(int count) noexcept
+{
+	int r = truth(count);
+	switch(count) {
+	case 0: return r + 1;
+	case 1: return r + 2;
+	case 4: r += 4; [[fallthrough]];
+	case 5:
+	default: return r + 5;
+	}
+}
+
+static int explain_cold(bool ufo, int count) noexcept
+{
+	if(!ufo) [[likely]]
+		return 0;
+
+	return explain_ufo(count);
+}
+
+using explainer = int (*)(bool, int) noexcept;
+
+struct variant {
+	char const* name;
+	explainer f;
+};
+
+static std::array<variant, 5> const variants{{
+	{"none", &explain_plain},
+	{"likely", &explain_likely},
+	{"wrong", &explain_wrong},
+	{"expect", &explain_expect},
+	{"cold", &explain_cold},
+}};
+
+
+
+////////////////////////////////////////////
+// Benchmark
+//
+
+struct sighting {
+	bool ufo;
+	int count;
+};
+
+// percent of the sightings are not a UFO, which is the hinted path. Either
+// randomly distributed, or in a regular pattern, which the branch predictor
+// learns. The same goes for the number of lights.
+static std::vector<sighting> sightings(size_t n, unsigned percent, bool random)
+{
+	static constexpr std::array<int, 8> counts{0, 1, 4, 4, 4, 5, 7, 4};
+	std::vector<sighting> s(n);
+	uint32_t x = 1;
+	for(size_t i = 0; i < n; i++) {
+		x = x * 1664525U + 1013904223U;
+		bool likely = random
+			? static_cast<uint64_t>(x) * 100U < static_cast<uint64_t>(percent) << 32U
+			: i % 20U < percent / 5U;
+		s[i] = {!likely, counts[random ? x >> 29U : i % counts.size()]};
+	}
+	return s;
+}
+
+static int run(explainer f, std::vector<sighting> const& s)
+{
+	int sum = 0;
+	for(auto const& x : s)
+		sum += f(x.ufo, x.count);
+	return sum;
+}
+
+int main(int argc, char** argv)
+{
+	// The hints do not change what happens.
+	for(auto const& v : variants)
+		if(v.f(false, 4) != 0 || v.f(true, 4) != explain_plain(true, 4) || v.f(true, 0) != explain_plain(true, 0))
+			return 1;
+
+	perf::counters counters;
+	bool counting = counters.available();
+	if(!counting)
+		std::cout << "Hardware performance counters are not available, only showing time." << std::endl;
+
+	// Try 10000000.
+	size_t n = bench::scale(argc, argv, 100'000);
+	auto nn = static_cast<double>(n);
+
+	std::cout << std::endl << n << " calls per cell; per call: ns";
+	if(counting)
+		std::cout << " / cycles / branch misses";
+	std::cout << std::endl << std::left << std::setw(17) << "likely path" << std::right;
+	for(auto const& v : variants)
+		std::cout << std::setw(counting ? 22 : 9) << v.name;
+	std::cout << std::endl;
+
+	int res = 0;
+	std::cout << std::fixed << std::setprecision(2);
+	for(bool random : {true, false}) {
+		for(unsigned percent : {0U, 10U, 50U, 90U, 100U}) {
+			auto s = sightings(n, percent, random);
+			std::cout << std::setw(3) << percent << "% " << std::left << std::setw(12)
+				<< (random ? "random" : "pattern") << std::right;
+
+			int expected = run(&explain_plain, s);
+			for(auto const& v : variants) {
+				perf::sample c;
+				int sum = 0;
+				{
+					perf::counter_scope scope{c, counters};
+					sum = run(v.f, s);
+					bench::escape(sum);
+				}
+				if(sum != expected)
+					res = 1;
+
+				std::cout << std::setw(9) << c.seconds * 1e9 / nn;
+				if(counting)
+					std::cout << " " << std::setw(6) << c.per(perf::cycles, n)
+						<< " " << std::setw(5) << c.per(perf::branch_misses, n);
+			}
+			std::cout << std::endl;
+		}
+	}
+	std::cout << std::defaultfloat << std::setprecision(6);
+
+	// The numbers are dominated by the branch predictor: random data at
+	// 50% costs a misprediction every other call, whatever the hint says.
+	// The regular pattern is learned, and is fast in all variants. The
+	// hints only move a few instructions around, which shows up as a
+	// cycle or so, in favor of the correct hint when the hinted path is
+	// indeed taken. A wrong hint costs about the same. Moving cold code
+	// away pays off when it saves instruction cache, which is when the hot
+	// code is large, not in a tiny loop like this one.
+	//
+	// So, use [[likely]] and [[unlikely]] for error paths that are really
+	// rare, and measure before sprinkling them around.
+	return res;
+}
+
+/*
+ * Further reading:
+ *
+ * https://en.cppreference.com/w/cpp/language/attributes/likely
+ * https://www.open-std.org/jtc1/sc22/wg21/docs/papers/2018/p0479r5.html
+ * https://gcc.gnu.org/onlinedocs/gcc/Other-Builtins.html#index-_005f_005fbuiltin_005fexpect
+ *
+ * See also 20210607_attributes and 20220314_perf_counters.
+ */
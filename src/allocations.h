@@ -0,0 +1,63 @@
+﻿/*
+ * Counting heap allocations
+ *
+ * Some tips are about avoiding heap allocations. To show that they do, this
+ * header replaces the global operator new, such that every allocation of the
+ * program is counted. Like bench.h, it is not a tip on its own.
+ *
+ * Replacing operator new is allowed once per program, so only include this
+ * header in a tip's single .cpp file. Note that exceptions are not allocated
+ * by operator new, so they are not counted.
+ */
+
+#ifndef TIPS_ALLOCATIONS_H
+#define TIPS_ALLOCATIONS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace bench {
+
+inline std::atomic<size_t> allocation_count{0};
+
+// The number of allocations so far. Take the difference of two calls to see
+// what happened in between.
+inline size_t allocations() noexcept
+{
+	return allocation_count.load(std::memory_order_relaxed);
+}
+
+} // namespace bench
+
+// GCC 11 and later warn that malloc and free do not match new and delete.
+// They do not have to: these are the replacements.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#  pragma GCC diagnostic push
+#  pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size)
+{
+	bench::allocation_count.fetch_add(1, std::memory_order_relaxed);
+	if(void* p = std::malloc(size > 0 ? size : 1)) // NOLINT(cppcoreguidelines-no-malloc,hicpp-no-malloc)
+		return p;
+	throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p); // NOLINT(cppcoreguidelines-no-malloc,hicpp-no-malloc)
+}
+
+void operator delete(void* p, size_t /*size*/) noexcept
+{
+	std::free(p); // NOLINT(cppcoreguidelines-no-malloc,hicpp-no-malloc)
+}
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#  pragma GCC diagnostic pop
+#endif
+
+#endif // TIPS_ALLOCATIONS_H
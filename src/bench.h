@@ -0,0 +1,208 @@
+﻿/*
+ * Benchmark helpers
+ *
+ * Some tips are not just about how to write something, but also about how
+ * fast it is. This header holds the few lines that these tips share to time a
+ * piece of code, and to see how large its machine code is. It is not a tip on
+ * its own; it is deliberately small, so you can read it in a few minutes and
+ * forget about it.
+ *
+ * All timing is done in the build type you configured. The default build type
+ * is Debug, with sanitizers enabled, so the numbers are only meaningful if you
+ * configure with -DCMAKE_BUILD_TYPE=Release.
+ *
+ * Configure with -DWITH_PERF_COUNTERS=ON to let measure() and count() also
+ * report the hardware performance counters of perf.h, when the system allows
+ * it. Only the calling thread is counted; work done by other threads is not.
+ */
+
+#ifndef TIPS_BENCH_H
+#define TIPS_BENCH_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__) && __has_include(<elf.h>)
+#  include <elf.h>
+#  include <fstream>
+#  define TIPS_HAVE_ELF 1
+#else
+#  define TIPS_HAVE_ELF 0
+#endif
+
+#include "perf.h"
+
+namespace bench {
+
+// Every benchmark accepts an optional scale as first argument. The default is
+// small, such that the tests (and valgrind) finish quickly.
+inline size_t scale(int argc, char** argv, size_t default_scale)
+{
+	if(argc < 2)
+		return default_scale;
+
+	auto s = std::strtoull(argv[1], nullptr, 0);
+	return s > 0 ? static_cast<size_t>(s) : default_scale;
+}
+
+// The optimizer is smart. If it sees that a result is not used, the
+// computation is removed altogether, and you are measuring nothing. Passing
+// the result to escape() makes the compiler believe that it is used.
+template <typename T>
+inline void escape(T const& x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	__asm__ volatile("" : : "g"(&x) : "memory");
+#else
+	static void const* volatile sink{};
+	sink = &x;
+#endif
+}
+
+// Run f() once, and return the time it takes in seconds, without reporting
+// anything, and without counters. Use count() for tables of results.
+template <typename F>
+inline double time(F&& f)
+{
+	auto start = std::chrono::steady_clock::now();
+	f();
+	auto stop = std::chrono::steady_clock::now();
+	return std::chrono::duration<double>(stop - start).count();
+}
+
+// Run f() once, and return the time and hardware counters. The counters are
+// only valid when they are enabled and available. Use this when the results
+// are printed differently, like in a table, and print the counters with
+// counters().
+template <typename F>
+inline perf::sample count(F&& f)
+{
+#ifdef TIPS_PERF_COUNTERS
+	perf::sample s;
+	{
+		perf::counter_scope scope{s};
+		f();
+	}
+	return s;
+#else
+	perf::sample s;
+	s.seconds = time(std::forward<F>(f));
+	return s;
+#endif
+}
+
+// Run f() once, and report the time it takes per operation. f is expected to
+// perform ops operations. The duration is returned in seconds.
+template <typename F>
+inline double measure(char const* name, size_t ops, F&& f)
+{
+	perf::sample c = count(std::forward<F>(f));
+	double s = c.seconds;
+	double n = static_cast<double>(ops > 0 ? ops : 1);
+
+	std::cout << "  " << std::left << std::setw(40) << name << std::right
+		<< std::fixed << std::setprecision(2)
+		<< std::setw(12) << s * 1e9 / n << " ns/op "
+		<< std::setw(12) << (s > 0 ? n / s * 1e-6 : 0.0) << " Mop/s";
+
+	if(c.any())
+		std::cout << std::endl << "  " << std::setw(40) << ""
+			<< std::setw(12) << c.per(perf::cycles, ops) << " cyc/op "
+			<< std::setw(12) << c.ipc() << " IPC   "
+			<< std::setw(6) << c.branch_miss_rate() * 100.0 << "% br-miss "
+			<< std::setw(8) << c.mpki(perf::l1d_misses) << " L1d-MPKI "
+			<< std::setw(8) << c.mpki(perf::llc_misses) << " LLC-MPKI";
+
+	std::cout << std::defaultfloat << std::setprecision(6) << std::endl;
+
+	return s;
+}
+
+// Print the counters of s in a table cell: cycles per operation, instructions
+// per cycle, and the branch-miss rate. Nothing when there are no counters.
+inline void counters(perf::sample const& s, size_t ops)
+{
+	if(!s.any())
+		return;
+
+	std::cout << std::setw(7) << s.per(perf::cycles, ops) << " cyc "
+		<< std::setw(4) << s.ipc() << " IPC "
+		<< std::setw(5) << s.branch_miss_rate() * 100.0 << "% br ";
+}
+
+// The success ratios, in percent, of benchmarks that compare how fast the
+// good and the bad path are.
+inline constexpr std::array<unsigned, 5> ratios{0, 25, 50, 75, 100};
+
+// A fixed, but unpredictable, pattern of n flags, of which percent are set. A
+// std::vector<char>, as a std::vector<bool> would add bit fiddling to every
+// lookup.
+inline std::vector<char> pattern(size_t n, unsigned percent)
+{
+	std::vector<char> ok(n);
+	uint32_t x = 1;
+	for(auto& o : ok) {
+		x = x * 1664525U + 1013904223U;
+		o = static_cast<uint64_t>(x) * 100U < static_cast<uint64_t>(percent) << 32U;
+	}
+	return ok;
+}
+
+// The size of all functions in this program whose (mangled) name contains
+// the given name, including parts that the compiler moved elsewhere, like
+// f.cold. This reads the symbol table of our own executable, which only works
+// for ELF (Linux), and when it is not stripped. Otherwise, 0. Only meaningful
+// in a Release build.
+inline size_t code_size(std::string_view name)
+{
+#if TIPS_HAVE_ELF
+	std::ifstream f{"/proc/self/exe", std::ios::binary};
+	auto read = [&f](void* dst, size_t offset, size_t size) {
+		f.seekg(static_cast<std::streamoff>(offset));
+		return static_cast<bool>(f.read(static_cast<char*>(dst), static_cast<std::streamsize>(size)));
+	};
+
+	Elf64_Ehdr eh{};
+	if(!read(&eh, 0, sizeof(eh)) || eh.e_ident[EI_CLASS] != ELFCLASS64)
+		return 0;
+
+	std::vector<Elf64_Shdr> sections(eh.e_shnum);
+	if(!read(sections.data(), eh.e_shoff, sections.size() * sizeof(Elf64_Shdr)))
+		return 0;
+
+	for(auto const& s : sections) {
+		if(s.sh_type != SHT_SYMTAB || s.sh_link >= sections.size())
+			continue;
+
+		auto const& strtab = sections[s.sh_link];
+		std::string names(strtab.sh_size, '\0');
+		std::vector<Elf64_Sym> symbols(s.sh_size / sizeof(Elf64_Sym));
+		if(!read(names.data(), strtab.sh_offset, names.size()) ||
+			!read(symbols.data(), s.sh_offset, symbols.size() * sizeof(Elf64_Sym)))
+			return 0;
+
+		size_t size = 0;
+		for(auto const& sym : symbols)
+			if(ELF64_ST_TYPE(sym.st_info) == STT_FUNC && sym.st_name < names.size() &&
+				std::string_view{names.c_str() + sym.st_name}.find(name) != std::string_view::npos)
+				size += sym.st_size;
+		return size;
+	}
+#else
+	(void)name;
+#endif
+	return 0;
+}
+
+} // namespace bench
+
+#endif // TIPS_BENCH_H
@@ -0,0 +1,252 @@
+﻿/*
+ * Hardware performance counters
+ *
+ * The time a piece of code takes tells you that it is slow, not why. The CPU
+ * counts what it does: cycles, instructions, mispredicted branches, cache
+ * misses. On Linux, perf_event_open() gives a process access to these
+ * counters for itself. This header wraps that in a few lines, like bench.h
+ * does for timing.
+ *
+ * The counters are not always available. Other platforms do not have
+ * perf_event_open(), containers often block it, and
+ * /proc/sys/kernel/perf_event_paranoid may forbid it. Then, only the time is
+ * measured, and every counter is reported as not valid.
+ */
+
+#ifndef TIPS_PERF_H
+#define TIPS_PERF_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__linux__) && __has_include(<linux/perf_event.h>)
+#  include <linux/perf_event.h>
+#  include <sys/ioctl.h>
+#  include <sys/syscall.h>
+#  include <time.h>
+#  include <unistd.h>
+#  define TIPS_HAVE_PERF 1
+#else
+#  include <chrono>
+#  define TIPS_HAVE_PERF 0
+#endif
+
+namespace perf {
+
+enum event : size_t {
+	cycles,
+	instructions,
+	branches,
+	branch_misses,
+	l1d_misses,
+	llc_misses,
+	events
+};
+
+inline constexpr std::array<char const*, events> event_names{
+	"cycles", "instructions", "branches", "branch-misses", "L1d-misses", "LLC-misses"};
+
+// The result of one measurement. A counter is only valid when the system
+// could count it.
+struct sample {
+	double seconds = 0;
+	std::array<uint64_t, events> count{};
+	std::array<bool, events> valid{};
+
+	bool has(event e) const noexcept { return valid[e]; }
+
+	bool any() const noexcept
+	{
+		for(auto v : valid)
+			if(v)
+				return true;
+		return false;
+	}
+
+	// Instructions per cycle. Below 1, the CPU is mostly waiting.
+	double ipc() const noexcept { return ratio(instructions, cycles); }
+
+	// The fraction of the branches that was mispredicted.
+	double branch_miss_rate() const noexcept { return ratio(branch_misses, branches); }
+
+	// Misses (or anything else) per 1000 instructions.
+	double mpki(event e) const noexcept { return ratio(e, instructions) * 1000.0; }
+
+	// Per operation, like ns/op.
+	double per(event e, size_t ops) const noexcept
+	{
+		return has(e) && ops > 0 ? static_cast<double>(count[e]) / static_cast<double>(ops) : 0.0;
+	}
+
+	double ratio(event a, event b) const noexcept
+	{
+		return has(a) && has(b) && count[b] > 0
+			? static_cast<double>(count[a]) / static_cast<double>(count[b]) : 0.0;
+	}
+};
+
+// A monotonic clock in seconds.
+inline double now() noexcept
+{
+#if TIPS_HAVE_PERF
+	timespec ts{};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) * 1e-9;
+#else
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// A group of counters, which are started and stopped together, such that
+// they count exactly the same code. Only this thread is counted, and only in
+// user space.
+class counters {
+public:
+	counters() noexcept
+	{
+		m_fd.fill(-1);
+#if TIPS_HAVE_PERF
+		struct config {
+			uint32_t type;
+			uint64_t config;
+		};
+
+		constexpr uint64_t l1d_read_miss = PERF_COUNT_HW_CACHE_L1D |
+			(PERF_COUNT_HW_CACHE_OP_READ << 8U) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16U);
+
+		std::array<config, events> const configs{{
+			{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+			{PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+			{PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS},
+			{PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+			{PERF_TYPE_HW_CACHE, l1d_read_miss},
+			{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+		}};
+
+		// The first one leads the group. The CPU (or virtual machine)
+		// may not support all others; just leave those out.
+		for(size_t e = 0; e < events; e++) {
+			int leader = e == 0 ? -1 : m_fd[0];
+			if(e > 0 && leader < 0)
+				break;
+
+			m_fd[e] = open(configs[e].type, configs[e].config, leader);
+			if(m_fd[e] >= 0)
+				m_slot[e] = m_members++;
+		}
+#endif
+	}
+
+	~counters()
+	{
+#if TIPS_HAVE_PERF
+		for(auto fd : m_fd)
+			if(fd >= 0)
+				close(fd);
+#endif
+	}
+
+	counters(counters const&) = delete;
+	counters& operator=(counters const&) = delete;
+
+	bool available() const noexcept { return m_fd[0] >= 0; }
+
+	void start() noexcept
+	{
+#if TIPS_HAVE_PERF
+		if(available()) {
+			ioctl(m_fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			ioctl(m_fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		}
+#endif
+		m_start = now();
+	}
+
+	sample stop() noexcept
+	{
+		sample s;
+		s.seconds = now() - m_start;
+
+#if TIPS_HAVE_PERF
+		if(!available())
+			return s;
+
+		ioctl(m_fd[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+		// nr, time enabled, time running, and a value per member.
+		std::array<uint64_t, 3 + events> buf{};
+		auto size = static_cast<ssize_t>(sizeof(uint64_t) * (3U + m_members));
+		if(read(m_fd[0], buf.data(), static_cast<size_t>(size)) != size || buf[0] != m_members || buf[2] == 0)
+			return s;
+
+		// When there are more counters in use than the CPU has, the
+		// kernel takes turns. Then, scale up to the full time.
+		double scale = static_cast<double>(buf[1]) / static_cast<double>(buf[2]);
+		for(size_t e = 0; e < events; e++) {
+			if(m_fd[e] < 0)
+				continue;
+			s.valid[e] = true;
+			s.count[e] = static_cast<uint64_t>(static_cast<double>(buf[3U + m_slot[e]]) * scale);
+		}
+#endif
+		return s;
+	}
+
+private:
+#if TIPS_HAVE_PERF
+	static int open(uint32_t type, uint64_t config, int leader) noexcept
+	{
+		perf_event_attr attr{};
+		attr.size = sizeof(attr);
+		attr.type = type;
+		attr.config = config;
+		if(leader < 0)
+			attr.disabled = 1U;
+		attr.exclude_kernel = 1U;
+		attr.exclude_hv = 1U;
+		attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+			PERF_FORMAT_TOTAL_TIME_RUNNING;
+		return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0));
+	}
+#endif
+
+	std::array<int, events> m_fd{};
+	std::array<size_t, events> m_slot{};
+	size_t m_members = 0;
+	double m_start = 0;
+};
+
+// One set of counters for the whole program, opened on first use. Like every
+// counters object, it only counts the thread that opened it. Work that is
+// handed to other threads, like parallel_sum() of 20220307_compensated_sum
+// does, is not counted, so its counts look better than they are.
+inline counters& instance() noexcept
+{
+	static counters c;
+	return c;
+}
+
+// Count the lifetime of this object, and store the result when it ends.
+class counter_scope {
+public:
+	explicit counter_scope(sample& result, counters& c = instance()) noexcept
+		: m_counters{c}
+		, m_result{result}
+	{
+		m_counters.start();
+	}
+
+	~counter_scope() { m_result = m_counters.stop(); }
+
+	counter_scope(counter_scope const&) = delete;
+	counter_scope& operator=(counter_scope const&) = delete;
+
+private:
+	counters& m_counters;
+	sample& m_result;
+};
+
+} // namespace perf
+
+#endif // TIPS_PERF_H